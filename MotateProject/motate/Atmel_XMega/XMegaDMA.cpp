@@ -0,0 +1,60 @@
+/*
+ XMegaDMA.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+
+#if defined(__AVR_XMEGA__)
+
+#include "Atmel_XMega/XMegaDMA.h"
+
+namespace Motate {
+    _XMegaDMAInterrupt *_first_xmega_dma_interrupt = nullptr;
+
+    // Each channel has its own vector, so find the owner of that channel
+    void _handleXMegaDMAInterrupt(const uint8_t channel) {
+        _XMegaDMAInterrupt *current = _first_xmega_dma_interrupt;
+        while (current != nullptr) {
+            if (current->channel_num == channel) {
+                current->interrupt_handler();
+                return;
+            }
+            current = current->next;
+        }
+
+        // Nobody owns it, so turn it off so we don't keep coming back here
+        DMA_XMega_common::setChannelInterruptLevel(channel, 0);
+    }
+}
+
+ISR(DMA_CH0_vect) { Motate::_handleXMegaDMAInterrupt(0); }
+ISR(DMA_CH1_vect) { Motate::_handleXMegaDMAInterrupt(1); }
+ISR(DMA_CH2_vect) { Motate::_handleXMegaDMAInterrupt(2); }
+ISR(DMA_CH3_vect) { Motate::_handleXMegaDMAInterrupt(3); }
+
+#endif // __AVR_XMEGA__
@@ -0,0 +1,617 @@
+/*
+ XMegaDMA.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+
+#ifndef XMEGADMA_H_ONCE
+#define XMEGADMA_H_ONCE
+
+#include "xmega.h"
+#include "avr/io.h"
+#include "MotateCommon.h"
+
+#include <functional>  // for std::function
+
+namespace Motate {
+    // avr-libc calls the DMA controller "DMA", which would replace every use of the DMA<> template
+    // below. So we grab the controller under another name here, and then put the macro aside until
+    // the end of this file, so DMA.CTRL and friends still work for everyone else.
+    // Use _xmegaDMAController() in here where you would have used DMA. Anything else that names the
+    // DMA<> template has to do the same push_macro/undef/pop_macro (see XMegaUART.h).
+    inline DMA_t& _xmegaDMAController() { return DMA; };
+}
+#pragma push_macro("DMA")
+#undef DMA
+
+namespace Motate {
+
+    // DMA template - MUST be specialized
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA {
+        DMA() = delete; // this prevents accidental direct instantiation
+        template<typename... T>
+        DMA(T...) {}; // this prevents accidental direct instantiation
+        static constexpr bool exists = false;
+    };
+
+    // The XMega A and AU parts have one DMA controller with four channels, each of which can be
+    // triggered by a peripheral. This is the same shape as the SAM XDMAC: each peripheral owns a
+    // DMA<> made of a TX and/or an RX half, and each half owns a channel.
+    //
+    // Since there are only four channels, a half doesn't take a channel until it's reset (which the
+    // peripherals do the first time they start a transfer), so owners that never use DMA don't use
+    // one up.
+    //
+    // Only byte-wide transfers are supported, which is all the USART and SPI can do anyway.
+
+    // DMA_XMega_TX_hardware and DMA_XMega_RX_hardware templates - MUST be specialized by the peripherals
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_XMega_TX_hardware {
+        DMA_XMega_TX_hardware() = delete;
+    };
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_XMega_RX_hardware {
+        DMA_XMega_RX_hardware() = delete;
+    };
+
+    static constexpr uint8_t kXMegaDMAChannelCount = 4;
+    static constexpr uint8_t kXMegaDMANoChannel    = 0xFF;
+
+    struct DMA_XMega_common {
+        static DMA_t& dma() { return _xmegaDMAController(); };
+        static DMA_CH_t * const dmaChannel(const uint8_t channel) { return &dma().CH0 + channel; };
+
+        static void enableController() {
+            PR.PRGEN &= ~PR_DMA_bm;
+            dma().CTRL |= DMA_ENABLE_bm;
+        };
+
+        // The address registers are three bytes wide, but data space pointers are only 16 bits
+        static void setAddress(volatile register8_t &address0, volatile void * const address) {
+            const uint16_t value = (uint16_t)address;
+            (&address0)[0] = value & 0xFF;
+            (&address0)[1] = value >> 8;
+            (&address0)[2] = 0;
+        };
+
+        // The XMega doesn't have priorities within a level, so the "priority" of the channel
+        // interrupts is the level they are on. This returns the TRNINTLVL for the priority.
+        static constexpr uint8_t interruptLevel(const Interrupt::Type interrupts) {
+            return (interrupts & (Interrupt::PriorityHighest | Interrupt::PriorityHigh)) ? DMA_CH_TRNINTLVL_HI_gc :
+                   (interrupts & Interrupt::PriorityMedium) ? DMA_CH_TRNINTLVL_MED_gc :
+                   DMA_CH_TRNINTLVL_LO_gc;
+        };
+
+        // Set the transaction-complete and error interrupts of a channel to level (zero is off).
+        // CTRLB also holds the flags, which are cleared by writing a one, so we mask them out.
+        static void setChannelInterruptLevel(const uint8_t channel, const uint8_t level) {
+            if (channel == kXMegaDMANoChannel) {
+                return;
+            }
+            DMA_CH_t * const ch = dmaChannel(channel);
+            ch->CTRLB = (ch->CTRLB & ~(DMA_CH_TRNINTLVL_gm | DMA_CH_ERRINTLVL_gm | DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm)) |
+                        level |
+                        (level << DMA_CH_ERRINTLVL_gp);
+        };
+    };
+
+    struct _XMegaDMAInterrupt {
+        const std::function<void(void)> interrupt_handler;
+        uint8_t                         channel_num = kXMegaDMANoChannel;
+        _XMegaDMAInterrupt*             next;
+
+        _XMegaDMAInterrupt(const _XMegaDMAInterrupt&) = delete;             // delete the copy constructor, we only allow moves
+        _XMegaDMAInterrupt &operator=(const _XMegaDMAInterrupt &) = delete; // delete the assigment operator, we only allow moves
+
+        // Note we MOVE construct this interrupt function...
+        _XMegaDMAInterrupt(const std::function<void(void)>&& _interrupt,
+                           _XMegaDMAInterrupt*&               _first)
+            : interrupt_handler{std::move(_interrupt)}, next{nullptr} {
+            if (_first == nullptr) {
+                _first = this;
+                return;
+            }
+
+            _XMegaDMAInterrupt* i = _first;
+            while (i->next != nullptr) {
+                i = i->next;
+            }
+            i->next = this;
+        };
+
+        // Take the lowest free channel, if we don't have one already.
+        // Returns false if all of the channels are taken.
+        bool claim(_XMegaDMAInterrupt* first) {
+            if (channel_num != kXMegaDMANoChannel) {
+                return true;
+            }
+
+            uint8_t used = 0;
+            for (_XMegaDMAInterrupt* i = first; i != nullptr; i = i->next) {
+                if (i->channel_num != kXMegaDMANoChannel) {
+                    used |= 1 << i->channel_num;
+                }
+            }
+            for (uint8_t channel = 0; channel < kXMegaDMAChannelCount; channel++) {
+                if (!(used & (1 << channel))) {
+                    channel_num = channel;
+                    return true;
+                }
+            }
+
+#if IN_DEBUGGER == 1
+            __asm__("break"); // out of DMA channels
+#endif
+            return false;
+        };
+
+        uint8_t getChannel() const { return channel_num; }
+    };
+
+    extern _XMegaDMAInterrupt *_first_xmega_dma_interrupt;
+
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_XMega_TX : virtual DMA_XMega_TX_hardware<periph_t, periph_num>, virtual DMA_XMega_common {
+        typedef DMA_XMega_TX_hardware<periph_t, periph_num> _hw;
+
+        using _hw::dmaTxTriggerSource;
+        using _hw::dmaPeripheralTxAddress;
+
+        typedef typename _hw::buffer_t buffer_t;
+
+        const std::function<void(Interrupt::Type)> &_dmaInterruptHandler;
+
+        // TRFCNT is reloaded at the end of a transaction, so we keep what was asked for
+        buffer_t _tx_buffer          = nullptr;
+        uint16_t _tx_length          = 0;
+        uint8_t  _tx_interrupt_level = DMA_CH_TRNINTLVL_LO_gc;
+
+        _XMegaDMAInterrupt _tx_interrupt{
+            [&]() {
+                const uint8_t ctrlb_hold = dmaTxChannel()->CTRLB;
+                Interrupt::Type cause = Interrupt::Unknown;
+                if (ctrlb_hold & DMA_CH_ERRIF_bm) {
+                    cause |= Interrupt::OnTxError;
+                } else if (ctrlb_hold & DMA_CH_TRNIF_bm) {
+                    cause |= Interrupt::OnTxTransferDone;
+                }
+                // writing back the flags that were set clears them, and leaves the levels alone
+                dmaTxChannel()->CTRLB = ctrlb_hold;
+
+                if (_dmaInterruptHandler) {
+                    _dmaInterruptHandler(cause);
+                }
+            },
+            _first_xmega_dma_interrupt};
+
+        const uint8_t dmaTxChannelNumber() const { return _tx_interrupt.getChannel(); }
+        DMA_CH_t * const dmaTxChannel() const
+        {
+            return dmaChannel(dmaTxChannelNumber());
+        };
+        bool hasTxChannel() const { return dmaTxChannelNumber() != kXMegaDMANoChannel; };
+
+        // we'll hold a reference to the handler, the peripheral owns the one it's passing
+        constexpr DMA_XMega_TX(const std::function<void(Interrupt::Type)> &handler) : _dmaInterruptHandler{handler} {};
+
+        bool resetTX()
+        {
+            if (!_tx_interrupt.claim(_first_xmega_dma_interrupt)) {
+                return false;
+            }
+
+            enableController();
+
+            // Configure the Tx
+            // ASSUMPTIONS:
+            //  * Tx is memory to peripheral, one byte per trigger
+            //  * The channel turns itself off at the end of the block (no REPEAT), so a transfer stops on its own
+            //
+            // If ANY of those assumptions are wrong, this code must change!!
+
+            disableTx();
+            dmaTxChannel()->CTRLA = DMA_CH_RESET_bm; // back to the reset values, including CTRLB
+            dmaTxChannel()->CTRLA =
+                DMA_CH_SINGLE_bm |                      // one burst for each trigger
+                DMA_CH_BURSTLEN_1BYTE_gc
+                ;
+            dmaTxChannel()->ADDRCTRL =
+                DMA_CH_SRCRELOAD_NONE_gc |
+                DMA_CH_SRCDIR_INC_gc |                  // the source address increments as written
+                DMA_CH_DESTRELOAD_NONE_gc |
+                DMA_CH_DESTDIR_FIXED_gc                 // destination address doesn't change (data register)
+                ;
+            setAddress(dmaTxChannel()->DESTADDR0, dmaPeripheralTxAddress());
+            dmaTxChannel()->TRIGSRC = dmaTxTriggerSource();
+
+            return true;
+        };
+
+        void disableTx() const
+        {
+            if (!hasTxChannel()) { return; }
+            dmaTxChannel()->CTRLA &= ~DMA_CH_ENABLE_bm;
+        };
+        void enableTx() const
+        {
+            dmaTxChannel()->CTRLA |= DMA_CH_ENABLE_bm;
+        };
+
+        uint8_t dummy_buffer = 0xff;
+        void setTx(void * const buffer, const uint16_t length)
+        {
+            dmaTxChannel()->CTRLB |= DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm; // clear the status before loading
+            dmaTxChannel()->ADDRCTRL =
+                (dmaTxChannel()->ADDRCTRL & ~DMA_CH_SRCDIR_gm) |
+                (buffer != nullptr ? DMA_CH_SRCDIR_INC_gc : DMA_CH_SRCDIR_FIXED_gc)
+                ;
+            setAddress(dmaTxChannel()->SRCADDR0, (buffer != nullptr ? buffer : &dummy_buffer));
+            dmaTxChannel()->TRFCNT = length;
+
+            _tx_buffer = (buffer_t)buffer;
+            _tx_length = length;
+        };
+        uint16_t leftToWrite(bool include_next = false) const
+        {
+            // once the channel has turned itself off, TRFCNT has been reloaded
+            if (!hasTxChannel() || !(dmaTxChannel()->CTRLA & DMA_CH_ENABLE_bm)) { return 0; }
+            return dmaTxChannel()->TRFCNT;
+        };
+        bool doneWriting(bool include_next = false) const
+        {
+            return leftToWrite(include_next) == 0;
+        };
+        buffer_t getTXTransferPosition() const
+        {
+            if (_tx_buffer == nullptr) { return nullptr; }
+            return _tx_buffer + (_tx_length - leftToWrite());
+        };
+
+        // Bundle it all up
+        bool startTXTransfer(void* const    buffer,
+                             const uint16_t length,
+                             const bool     handle_interrupts = true,
+                             const bool     include_next      = false,
+                             const uint8_t  byte_width        = 1
+                            )
+        {
+            if (byte_width != 1) { return false; }
+            if (!hasTxChannel() && !resetTX()) {
+                return false;
+            }
+            if (doneWriting()) {
+                disableTx();
+                if (handle_interrupts) { stopTxDoneInterrupts(); }
+                setTx(buffer, length);
+                if (length != 0) {
+                    if (handle_interrupts) { startTxDoneInterrupts(); }
+                    enableTx();
+                    return true;
+                }
+                return false;
+            }
+            return false;
+        };
+
+        void startTxDoneInterrupts() const { setChannelInterruptLevel(dmaTxChannelNumber(), _tx_interrupt_level); };
+        void stopTxDoneInterrupts() const { setChannelInterruptLevel(dmaTxChannelNumber(), 0); };
+
+        void setTxInterruptPriority(const Interrupt::Type interrupts) {
+            _tx_interrupt_level = interruptLevel(interrupts);
+            if (hasTxChannel() && (dmaTxChannel()->CTRLB & DMA_CH_TRNINTLVL_gm)) {
+                startTxDoneInterrupts();
+            }
+        };
+
+        // This gets called from the peripheral interrupt handler, and must always return false
+        constexpr bool inTxBufferEmptyInterrupt() const { return false; };
+    };
+
+    // DMA_XMega is split into two halves, TX and RX. Each or both can be inherited from.
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_XMega_RX : virtual DMA_XMega_RX_hardware<periph_t, periph_num>, virtual DMA_XMega_common {
+        typedef DMA_XMega_RX_hardware<periph_t, periph_num> _hw;
+
+        using _hw::dmaRxTriggerSource;
+        using _hw::dmaPeripheralRxAddress;
+
+        typedef typename _hw::buffer_t buffer_t;
+
+        const std::function<void(Interrupt::Type)> &_dmaInterruptHandler;
+
+        // TRFCNT is reloaded at the end of a transaction, so we keep what was asked for
+        buffer_t _rx_buffer          = nullptr;
+        uint16_t _rx_length          = 0;
+        uint8_t  _rx_interrupt_level = DMA_CH_TRNINTLVL_LO_gc;
+
+        _XMegaDMAInterrupt _rx_interrupt{
+            [&]() {
+                const uint8_t ctrlb_hold = dmaRxChannel()->CTRLB;
+                Interrupt::Type cause = Interrupt::Unknown;
+                if (ctrlb_hold & DMA_CH_ERRIF_bm) {
+                    cause |= Interrupt::OnRxError;
+                } else if (ctrlb_hold & DMA_CH_TRNIF_bm) {
+                    cause |= Interrupt::OnRxTransferDone;
+                }
+                // writing back the flags that were set clears them, and leaves the levels alone
+                dmaRxChannel()->CTRLB = ctrlb_hold;
+
+                if (_dmaInterruptHandler) {
+                    _dmaInterruptHandler(cause);
+                }
+            },
+            _first_xmega_dma_interrupt};
+
+        const uint8_t dmaRxChannelNumber() const { return _rx_interrupt.getChannel(); }
+        DMA_CH_t * const dmaRxChannel() const
+        {
+            return dmaChannel(dmaRxChannelNumber());
+        };
+        bool hasRxChannel() const { return dmaRxChannelNumber() != kXMegaDMANoChannel; };
+
+        constexpr DMA_XMega_RX(const std::function<void(Interrupt::Type)> &handler) : _dmaInterruptHandler{handler} {};
+
+        bool resetRX()
+        {
+            if (!_rx_interrupt.claim(_first_xmega_dma_interrupt)) {
+                return false;
+            }
+
+            enableController();
+
+            // Configure the Rx
+            // ASSUMPTIONS:
+            //  * Rx is from peripheral to memory, one byte per trigger
+            //  * The channel turns itself off at the end of the block (no REPEAT), so a transfer stops on its own
+            //
+            // If ANY of those assumptions are wrong, this code must change!!
+
+            disableRx();
+            dmaRxChannel()->CTRLA = DMA_CH_RESET_bm; // back to the reset values, including CTRLB
+            dmaRxChannel()->CTRLA =
+                DMA_CH_SINGLE_bm |                      // one burst for each trigger
+                DMA_CH_BURSTLEN_1BYTE_gc
+                ;
+            dmaRxChannel()->ADDRCTRL =
+                DMA_CH_SRCRELOAD_NONE_gc |
+                DMA_CH_SRCDIR_FIXED_gc |                // the source address doesn't change (data register)
+                DMA_CH_DESTRELOAD_NONE_gc |
+                DMA_CH_DESTDIR_INC_gc                   // destination address increments as read
+                ;
+            setAddress(dmaRxChannel()->SRCADDR0, dmaPeripheralRxAddress());
+            dmaRxChannel()->TRIGSRC = dmaRxTriggerSource();
+
+            return true;
+        };
+
+        void disableRx() const
+        {
+            if (!hasRxChannel()) { return; }
+            dmaRxChannel()->CTRLA &= ~DMA_CH_ENABLE_bm;
+        };
+        void enableRx() const
+        {
+            dmaRxChannel()->CTRLA |= DMA_CH_ENABLE_bm;
+        };
+
+        uint8_t dummy_buffer = 0xff;
+        void setRx(void* const buffer, const uint16_t length) {
+            dmaRxChannel()->CTRLB |= DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm; // clear the status before loading
+            dmaRxChannel()->ADDRCTRL =
+                (dmaRxChannel()->ADDRCTRL & ~DMA_CH_DESTDIR_gm) |
+                (buffer != nullptr ? DMA_CH_DESTDIR_INC_gc : DMA_CH_DESTDIR_FIXED_gc)
+                ;
+            setAddress(dmaRxChannel()->DESTADDR0, (buffer != nullptr ? buffer : &dummy_buffer));
+            dmaRxChannel()->TRFCNT = length;
+
+            _rx_buffer = (buffer_t)buffer;
+            _rx_length = length;
+        };
+        uint16_t leftToRead(bool include_next = false) const
+        {
+            // once the channel has turned itself off, TRFCNT has been reloaded
+            if (!hasRxChannel() || !(dmaRxChannel()->CTRLA & DMA_CH_ENABLE_bm)) { return 0; }
+            return dmaRxChannel()->TRFCNT;
+        };
+        bool doneReading(bool include_next = false) const
+        {
+            return leftToRead(include_next) == 0;
+        };
+        buffer_t getRXTransferPosition() const
+        {
+            if (_rx_buffer == nullptr) { return nullptr; }
+            return _rx_buffer + (_rx_length - leftToRead());
+        };
+
+        // Bundle it all up
+        bool startRXTransfer(void * const buffer,
+                             const uint16_t length,
+                             const bool handle_interrupts = true,
+                             const bool include_next = false,
+                             const uint8_t byte_width = 1
+                             )
+        {
+            if ((0 == length) || (byte_width != 1)) { return false; }
+            if (!hasRxChannel() && !resetRX()) {
+                return false;
+            }
+
+            disableRx();
+            if (handle_interrupts) {
+                stopRxDoneInterrupts();
+            }
+            setRx(buffer, length);
+            if (handle_interrupts) {
+                startRxDoneInterrupts();
+            }
+            enableRx();
+
+            return true;
+        };
+
+        void startRxDoneInterrupts() const { setChannelInterruptLevel(dmaRxChannelNumber(), _rx_interrupt_level); };
+        void stopRxDoneInterrupts() const { setChannelInterruptLevel(dmaRxChannelNumber(), 0); };
+
+        void setRxInterruptPriority(const Interrupt::Type interrupts) {
+            _rx_interrupt_level = interruptLevel(interrupts);
+            if (hasRxChannel() && (dmaRxChannel()->CTRLB & DMA_CH_TRNINTLVL_gm)) {
+                startRxDoneInterrupts();
+            }
+        };
+
+        // This gets called from the peripheral interrupt handler, and must always return false
+        constexpr bool inRxBufferFullInterrupt() const { return false; };
+    };
+
+    // Construct a DMA for a peripheral that has both halves
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_XMega : DMA_XMega_RX<periph_t, periph_num>, DMA_XMega_TX<periph_t, periph_num> {
+        typedef DMA_XMega_RX<periph_t, periph_num> _rx;
+        typedef DMA_XMega_TX<periph_t, periph_num> _tx;
+
+        constexpr DMA_XMega(const std::function<void(Interrupt::Type)> &handler) : _rx{handler}, _tx{handler} {};
+
+        void setInterrupts(const Interrupt::Type interrupts)
+        {
+            if (interrupts != Interrupt::Off) {
+                if (interrupts & Interrupt::OnTxTransferDone) {
+                    _tx::setTxInterruptPriority(interrupts);
+                    _tx::startTxDoneInterrupts();
+                } else {
+                    _tx::stopTxDoneInterrupts();
+                }
+
+                if (interrupts & Interrupt::OnRxTransferDone) {
+                    _rx::setRxInterruptPriority(interrupts);
+                    _rx::startRxDoneInterrupts();
+                } else {
+                    _rx::stopRxDoneInterrupts();
+                }
+            } else {
+                _tx::stopTxDoneInterrupts();
+                _rx::stopRxDoneInterrupts();
+            }
+        };
+
+        bool reset() {
+            return _tx::resetTX() && _rx::resetRX();
+        };
+    };
+
+
+    // The trigger sources are laid out by port: C is 0x40, D is 0x60, E is 0x80, and F is 0xA0.
+    // From there SPI is +0x0A, USARTn0 RXC and DRE are +0x0B and +0x0C, and USARTn1 are +0x0E and +0x0F.
+    static constexpr uint8_t _xmegaDMAPortTrigger(const uint8_t port_index) { return 0x40 + (port_index * 0x20); };
+
+#pragma mark DMA_XMega USART implementation
+
+    // uartPeripheralNumber is the same as for _UARTHardware<>: 0 is USARTC0, 1 is USARTC1, ... 6 is USARTF0
+    inline USART_t& _xmegaDMAUSART(const uint8_t uartPeripheralNumber) {
+        switch (uartPeripheralNumber) {
+            case 0: return USARTC0;
+            case 1: return USARTC1;
+            case 2: return USARTD0;
+            case 3: return USARTD1;
+            case 4: return USARTE0;
+            case 5: return USARTE1;
+            default: return USARTF0;
+        }
+    };
+
+    template<uint8_t uartPeripheralNumber>
+    struct DMA_XMega_TX_hardware<USART_t*, uartPeripheralNumber> {
+        typedef char* buffer_t;
+
+        // Triggered by DRE, so it starts as soon as the channel is enabled
+        static constexpr uint8_t dmaTxTriggerSource() {
+            return _xmegaDMAPortTrigger(uartPeripheralNumber >> 1) + ((uartPeripheralNumber & 1) ? 0x0F : 0x0C);
+        };
+        static volatile void * const dmaPeripheralTxAddress() { return &_xmegaDMAUSART(uartPeripheralNumber).DATA; };
+    };
+
+    template<uint8_t uartPeripheralNumber>
+    struct DMA_XMega_RX_hardware<USART_t*, uartPeripheralNumber> {
+        typedef char* buffer_t;
+
+        static constexpr uint8_t dmaRxTriggerSource() {
+            return _xmegaDMAPortTrigger(uartPeripheralNumber >> 1) + ((uartPeripheralNumber & 1) ? 0x0E : 0x0B);
+        };
+        static volatile void * const dmaPeripheralRxAddress() { return &_xmegaDMAUSART(uartPeripheralNumber).DATA; };
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<USART_t*, periph_num> : DMA_XMega<USART_t*, periph_num> {
+        // nothing to do here, except for a constxpr constructor
+        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_XMega<USART_t*, periph_num>{handler} {};
+    };
+
+
+#pragma mark DMA_XMega SPI implementation
+
+    // spiPeripheralNumber is 0 for SPIC, 1 for SPID, 2 for SPIE, and 3 for SPIF.
+    //
+    // The SPI only has one trigger, transfer complete, for both halves. So the driver has to write
+    // the first byte itself, and the RX half should be started first so that it has the lower
+    // channel, and reads each byte before the TX half writes the next one.
+    inline SPI_t& _xmegaDMASPI(const uint8_t spiPeripheralNumber) {
+        switch (spiPeripheralNumber) {
+            case 0: return SPIC;
+            case 1: return SPID;
+            case 2: return SPIE;
+            default: return SPIF;
+        }
+    };
+
+    template<uint8_t spiPeripheralNumber>
+    struct DMA_XMega_TX_hardware<SPI_t*, spiPeripheralNumber> {
+        typedef uint8_t* buffer_t;
+
+        static constexpr uint8_t dmaTxTriggerSource() { return _xmegaDMAPortTrigger(spiPeripheralNumber) + 0x0A; };
+        static volatile void * const dmaPeripheralTxAddress() { return &_xmegaDMASPI(spiPeripheralNumber).DATA; };
+    };
+
+    template<uint8_t spiPeripheralNumber>
+    struct DMA_XMega_RX_hardware<SPI_t*, spiPeripheralNumber> {
+        typedef uint8_t* buffer_t;
+
+        static constexpr uint8_t dmaRxTriggerSource() { return _xmegaDMAPortTrigger(spiPeripheralNumber) + 0x0A; };
+        static volatile void * const dmaPeripheralRxAddress() { return &_xmegaDMASPI(spiPeripheralNumber).DATA; };
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<SPI_t*, periph_num> : DMA_XMega<SPI_t*, periph_num> {
+        // nothing to do here, except for a constxpr constructor
+        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_XMega<SPI_t*, periph_num>{handler} {};
+    };
+
+} // namespace Motate
+
+#pragma pop_macro("DMA")
+
+#endif /* end of include guard: XMEGADMA_H_ONCE */
@@ -34,6 +34,7 @@
 
 #include "MotatePins.h"
 #include "MotateBuffer.h"
+#include "XMegaDMA.h"
 #include "stdlib.h"
 #include "math.h"
 #include "xmega.h"
@@ -573,9 +574,37 @@ namespace Motate {
         _UARTHardware< UARTGetPeripheralNum<rxPinNumber, txPinNumber>::uartPeripheralNum > hardware;
         const inline uint8_t uartPeripheralNum() { return hardware.uartNum; };
 
+        // DMA transfers, for use with RXBuffer and TXBuffer (see MotateBuffer.h)
+        std::function<void(Interrupt::Type)> _dmaInterruptHandler;
+#pragma push_macro("DMA")
+#undef DMA
+        DMA<USART_t*, UARTGetPeripheralNum<rxPinNumber, txPinNumber>::uartPeripheralNum> dma {_dmaInterruptHandler};
+#pragma pop_macro("DMA")
+
+        std::function<void(void)> transfer_rx_done_callback;
+        std::function<void(void)> transfer_tx_done_callback;
+
         UART(const uint32_t baud = 115200, const uint16_t options = UARTMode::As8N1) {
             hardware.init();
             init(baud, options, /*fromConstructor =*/ true);
+
+            _dmaInterruptHandler = [&](Interrupt::Type cause) {
+                if (cause & Interrupt::OnTxTransferDone) {
+                    if (transfer_tx_done_callback) {
+                        transfer_tx_done_callback();
+                    }
+                }
+                if (cause & Interrupt::OnRxTransferDone) {
+                    if (transfer_rx_done_callback) {
+                        transfer_rx_done_callback();
+                    }
+                }
+#if IN_DEBUGGER == 1
+                if (cause & (Interrupt::OnTxError | Interrupt::OnRxError)) {
+                    __asm__("break"); // DMA bus error
+                }
+#endif
+            };
         };
 
         void init(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
@@ -684,6 +713,43 @@ namespace Motate {
 
             return total_written;
         };
+
+        // **** DMA transfers
+        // These have the same interface as on the SAM, so this can be the owner of an RXBuffer or TXBuffer.
+        // The channels are triggered by RXC and DRE directly, so the USART interrupts stay off.
+
+        // The XMega DMA can only do one block, so buffer2 and length2 are ignored
+        bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2 = nullptr, const uint16_t length2 = 0) {
+            return dma.startRXTransfer(buffer, length);
+        };
+
+        char* getRXTransferPosition() {
+            return dma.getRXTransferPosition();
+        };
+
+        void setRXTransferDoneCallback(const std::function<void()> &callback) {
+            transfer_rx_done_callback = callback;
+        }
+
+        void setRXTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_rx_done_callback = std::move(callback);
+        }
+
+        bool startTXTransfer(char *buffer, const uint16_t length) {
+            return dma.startTXTransfer(buffer, length);
+        };
+
+        char* getTXTransferPosition() {
+            return dma.getTXTransferPosition();
+        };
+
+        void setTXTransferDoneCallback(const std::function<void()> &callback) {
+            transfer_tx_done_callback = callback;
+        }
+
+        void setTXTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_tx_done_callback = std::move(callback);
+        }
     };
 
     template<uint8_t uartPeripheralNumber, pin_number rtsPinNumber, pin_number ctsPinNumber, typename rxBufferClass, typename txBufferClass>
@@ -306,6 +306,8 @@ namespace Motate {
 
         static constexpr uint32_t _get_endpoint_max_nbr() { return (9); };
         static constexpr uint32_t MAX_PEP_NB() { return (_get_endpoint_max_nbr() + 1); };
+        // Only endpoints 1 through 7 have a DMA channel (UOTGHS_DEVDMA[ep-1]).
+        static constexpr uint32_t _get_dma_endpoint_max_nbr() { return (7); };
 
         // callback for after a control read is done
         std::function<void(void)> _control_read_completed_callback;
@@ -837,6 +839,55 @@ namespace Motate {
             return (uint8_t *)(UOTGHS_RAM_ADDR_c + (ep * 0x8000));
         }
 
+        // Copy to and from an endpoint FIFO a word at a time. The FIFO only needs the HSB address to match
+        // the DPRAM pointer modulo 4 (see the warning above), so bytes are copied until the FIFO address is
+        // word aligned, then words, then the remaining bytes. The buffer side may be unaligned, which the
+        // M3/M7 handle for single loads and stores. Both return where the FIFO pointer ended up, so a
+        // packet can be built from more than one buffer.
+
+        static volatile uint8_t *_copyToFifo(volatile uint8_t *fifo, const char *buffer, uint16_t length) {
+            while (length && ((uint32_t)fifo & 0x3)) {
+                *fifo++ = *buffer++;
+                length--;
+            }
+
+            volatile uint32_t *fifo32 = (volatile uint32_t *)fifo;
+            while (length >= 4) {
+                uint32_t word;
+                memcpy(&word, buffer, 4);
+                *fifo32++ = word;
+                buffer += 4;
+                length -= 4;
+            }
+
+            fifo = (volatile uint8_t *)fifo32;
+            while (length--) {
+                *fifo++ = *buffer++;
+            }
+            return fifo;
+        }
+
+        static volatile uint8_t *_copyFromFifo(volatile uint8_t *fifo, char *buffer, uint16_t length) {
+            while (length && ((uint32_t)fifo & 0x3)) {
+                *buffer++ = *fifo++;
+                length--;
+            }
+
+            volatile uint32_t *fifo32 = (volatile uint32_t *)fifo;
+            while (length >= 4) {
+                uint32_t word = *fifo32++;
+                memcpy(buffer, &word, 4);
+                buffer += 4;
+                length -= 4;
+            }
+
+            fifo = (volatile uint8_t *)fifo32;
+            while (length--) {
+                *buffer++ = *fifo++;
+            }
+            return fifo;
+        }
+
         void _init() {
             // FORCE disable the USB hardware:
             UOTGHS->UOTGHS_CTRL &= ~(UOTGHS_CTRL_USBE);
@@ -1266,11 +1317,7 @@ namespace Motate {
             if (length < 0)
                 return -1;
 
-            int16_t to_read = length;
-            volatile uint8_t *src = _dev_fifo(0);
-            while (to_read-- > 0) {
-                *buffer++ = *src++;
-            }
+            _copyFromFifo(_dev_fifo(0), buffer, length);
             return length;
         };
 
@@ -1360,10 +1407,11 @@ namespace Motate {
                     _setup_buffer.length_0 = _setup_buffer.length_1; _setup_buffer.length_1 = 0;
                     _setup_buffer.buf_addr_0 = _setup_buffer.buf_addr_1; _setup_buffer.buf_addr_1 = nullptr;
                 }
-                *dst++ = *_setup_buffer.buf_addr_0;
-                _setup_buffer.buf_addr_0++;
-                _setup_buffer.length_0--;
-                to_send--;
+                uint16_t chunk = std::min(to_send, _setup_buffer.length_0);
+                dst = _copyToFifo(dst, _setup_buffer.buf_addr_0, chunk);
+                _setup_buffer.buf_addr_0 += chunk;
+                _setup_buffer.length_0 -= chunk;
+                to_send -= chunk;
             }
 
             _ack_in_send(0);
@@ -1486,7 +1534,7 @@ namespace Motate {
                                 _ack_in_send(ep); // A
                                 _ack_fifocon(ep); // B - This bit is cleared (by writing a one to UOTGHS_DEVEPTIDRx.FIFOCONC bit) to send the FIFO data and to switch to the next bank.
                             } else {
-                                if (!transfer_completed) {
+                                if (!transfer_completed && _is_dma_on_last_descriptor(ep)) {
                                     _completeTransfer(ep); // C+D
                                     transfer_completed = true;
                                 }
@@ -1508,9 +1556,11 @@ namespace Motate {
                                 _ack_out_received(ep); // A
                                 // B - This bit is cleared (by writing a one to UOTGHS_DEVEPTIDRx.FIFOCONC bit) to free the current bank and to switch to the next bank.
                                 _ack_fifocon(ep);
+                                // The DMA has already moved the packet, so the length isn't known here
+                                proxy->handleDataAvailable(ep, 0);
                             } else {
                                 // case 6
-                                if (!transfer_completed) {
+                                if (!transfer_completed && _is_dma_on_last_descriptor(ep)) {
                                     if (0 == (_devdma_status(ep) & UOTGHS_DEVDMASTATUS_CHANN_ACT)) {
                                         _completeTransfer(ep); // C+D
                                         transfer_completed = true;
@@ -1546,7 +1596,19 @@ namespace Motate {
                         }
                     }
 
-                    if (ep_status & UOTGHS_DEVDMASTATUS_END_TR_ST) {
+                    if ((ep_status & UOTGHS_DEVDMASTATUS_END_TR_ST) && _dma_second_descriptor[ep]) {
+                        // a two buffer RX OUT got a short packet in its first buffer, so that's the end of it
+                        _dma_second_descriptor[ep] = nullptr;
+                    } else if ((ep_status & UOTGHS_DEVDMASTATUS_END_BF_ST) && _dma_second_descriptor[ep]) {
+                        // the first buffer of a two buffer RX OUT filled without a short packet, go on to the second
+                        _devdma(ep)->next_descriptor = _dma_second_descriptor[ep];
+                        _dma_second_descriptor[ep] = nullptr;
+                        _devdma(ep)->command = USB_DMA_Descriptor::load_next_desc;
+                        handled = true;
+                        continue;
+                    }
+
+                    if ((ep_status & UOTGHS_DEVDMASTATUS_END_TR_ST) && _is_dma_on_last_descriptor(ep)) {
                         // case 2
                         if (!transfer_completed) {
                             _completeTransfer(ep); // C+D
@@ -1554,7 +1616,7 @@ namespace Motate {
                         }
                     }
 
-                    if (ep_status & UOTGHS_DEVDMASTATUS_END_BF_ST)
+                    if ((ep_status & UOTGHS_DEVDMASTATUS_END_BF_ST) && _is_dma_on_last_descriptor(ep))
                     {
                         // case 2, 4, or 7
 
@@ -1578,11 +1640,57 @@ namespace Motate {
             return handled;
         };
 
+        // The second buffer of an RX OUT transfer that can end in its first, loaded once the first fills. See transfer().
+        USB_DMA_Descriptor* _dma_second_descriptor[MAX_PEP_NB()] = {};
+
+        // True if the DMA channel of ep is on the last (or only) descriptor of its transfer.
+        bool _is_dma_on_last_descriptor(const uint32_t ep) {
+            return (_devdma(ep)->command != USB_DMA_Descriptor::run_and_link) && (_dma_second_descriptor[ep] == nullptr);
+        };
+
+        // Like transfer(ep, desc), but continues from desc's buffer into desc2's, as one transfer with one
+        // call to handleTransferDone(). desc2 is set up like a lone descriptor would be, and desc just
+        // links to it without validating packets or interrupting.
+        //
+        // An RX OUT with end_transfer_enable set on desc has to be able to end in the first buffer, but the
+        // DMA would load a linked descriptor after the short packet and carry on into the second buffer. So
+        // desc2 isn't linked, and checkAndHandleEndpoint() loads it when the first buffer fills.
+        bool transfer(const uint8_t ep, USB_DMA_Descriptor& desc, USB_DMA_Descriptor* desc2) {
+            _dma_second_descriptor[ep] = nullptr;
+            if (!desc2 || (desc2->buffer_length == 0)) {
+                return transfer(ep, desc);
+            }
+            if (!config_number)
+                return false;
+
+            if (!_is_endpoint_a_tx_in(ep) && desc.end_transfer_enable) {
+                desc.end_transfer_interrupt_enable = true;
+                _dma_second_descriptor[ep] = desc2;
+                return _transfer(ep, desc, desc);
+            }
+
+            desc.command = USB_DMA_Descriptor::run_and_link;
+            desc.next_descriptor = desc2;
+            desc.end_buffer_enable = false;
+            desc.end_transfer_interrupt_enable = false;
+            desc.end_buffer_interrupt_enable = false;
+            desc.descriptor_loaded_interrupt_enable = false;
+
+            return _transfer(ep, desc, *desc2);
+        };
+
         bool transfer(const uint8_t ep, USB_DMA_Descriptor& desc) {
+            _dma_second_descriptor[ep] = nullptr;
             if (!config_number)
                 return false;
 
+            return _transfer(ep, desc, desc);
+        };
+
+        // Set up desc as the final descriptor, and start the DMA on first (which may be desc).
+        bool _transfer(const uint8_t ep, USB_DMA_Descriptor& first, USB_DMA_Descriptor& desc) {
             desc.command = USB_DMA_Descriptor::run_and_stop;
+            desc.next_descriptor = nullptr;
             // DON'T interrupt when the descriptor is loaded
             desc.descriptor_loaded_interrupt_enable = false;
             if (_is_endpoint_a_tx_in(ep)) {
@@ -1594,7 +1702,7 @@ namespace Motate {
                 // interrupt when the DMA transfer ends because USB stopped it
                 desc.end_transfer_interrupt_enable = true;
                 // we use the descriptor loaded to turn on the other iterrupts
-                desc.descriptor_loaded_interrupt_enable = true;
+                first.descriptor_loaded_interrupt_enable = true;
             }
 //            else {
 //                // if the endpoint is an RX OUT:
@@ -1613,7 +1721,7 @@ namespace Motate {
             _dma_used_by_endpoint |= 1 << ep;
 
             // IMPORTANT: UOTGHS_DEVDMA[0] is endpoint 1!!
-            _devdma(ep)->next_descriptor = &desc;
+            _devdma(ep)->next_descriptor = &first;
             _devdma(ep)->command = USB_DMA_Descriptor::load_next_desc;
 
             if (_is_endpoint_a_tx_in(ep)) {
@@ -1641,9 +1749,9 @@ namespace Motate {
 //            _flushReadEndpoint(endpoint);
         }
 
-//        void enableRXInterrupt(const uint8_t endpoint) {
-//            _enable_out_received_interrupt(endpoint);
-//        };
+        // OUT transfers here are always walked along packet-by-packet, and transfer() turns the RXOUT
+        // interrupt on, so proxy->handleDataAvailable() is already called as each packet arrives.
+        void enableRXInterrupt(const uint8_t endpoint) {};
 
         void disableRXInterrupt(const uint8_t endpoint) {
             _disable_out_received_interrupt(endpoint);
@@ -102,6 +102,18 @@ namespace Motate {
     _MAKE_MOTATE_SPI_MOSI_PIN('A', 26, /* SPINum:*/ 0, /* Peripheral */ A);
     _MAKE_MOTATE_SPI_SCK_PIN ('A', 27, /* SPINum:*/ 0, /* Peripheral */ A);
 
+    // USARTs in SPI master mode
+    // NOTE: SPIs 4 and up (here) are USART0 and up, and the RTS pin is the (only) CS
+    _MAKE_MOTATE_SPI_CS_PIN  ('B', 25, /* SPINum:*/ 4+0, /* Peripheral:*/ A, /* CS Index:*/ 0);
+    _MAKE_MOTATE_SPI_MISO_PIN('A', 10, /* SPINum:*/ 4+0, /* Peripheral */ A);
+    _MAKE_MOTATE_SPI_MOSI_PIN('A', 11, /* SPINum:*/ 4+0, /* Peripheral */ A);
+    _MAKE_MOTATE_SPI_SCK_PIN ('A', 17, /* SPINum:*/ 4+0, /* Peripheral */ B);
+
+    _MAKE_MOTATE_SPI_CS_PIN  ('A', 14, /* SPINum:*/ 4+1, /* Peripheral:*/ A, /* CS Index:*/ 0);
+    _MAKE_MOTATE_SPI_MISO_PIN('A', 12, /* SPINum:*/ 4+1, /* Peripheral */ A);
+    _MAKE_MOTATE_SPI_MOSI_PIN('A', 13, /* SPINum:*/ 4+1, /* Peripheral */ A);
+    _MAKE_MOTATE_SPI_SCK_PIN ('A', 16, /* SPINum:*/ 4+1, /* Peripheral */ A);
+
     // UART Pin Assignments
     // NOTE: UART 4 is UART hardware
     //       UARTs 0,1 and 2 are USART0 and up (note the S in USART!)
@@ -134,6 +134,26 @@ namespace Motate {
             return (buffer_t)pdc->PERIPH_RPR;
         };
 
+        // Stop the RX transfer, but only if it's at expected_position, otherwise it's left running.
+        // With releaseRx(), this is used to strip bytes out of the received stream.
+        bool holdRx(void * const expected_position) const
+        {
+            disableRx();
+            if (pdc->PERIPH_RPR != (uint32_t)expected_position) {
+                enableRx();
+                return false;
+            }
+            return true;
+        };
+        // Restart a transfer stopped by holdRx() count bytes back, so the next bytes received overwrite those.
+        // If enable is false it's moved back but left stopped, for enableRx() later.
+        void releaseRx(const uint32_t count, const bool enable = true) const
+        {
+            pdc->PERIPH_RPR = pdc->PERIPH_RPR - count;
+            pdc->PERIPH_RCR = pdc->PERIPH_RCR + count;
+            if (enable) { enableRx(); }
+        };
+
         // Bundle it all up
         bool startRXTransfer(void* const    buffer,
                              const uint32_t length,
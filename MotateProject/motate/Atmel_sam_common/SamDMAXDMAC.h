@@ -470,6 +470,33 @@ namespace Motate {
             return (buffer_t)xdmaRxChannel()->XDMAC_CDA;
         };
 
+        // Stop the RX transfer, but only if it's at expected_position, otherwise it's left running.
+        // With releaseRx(), this is used to strip bytes out of the received stream.
+        bool holdRx(void * const expected_position) const
+        {
+            const bool was_running = xdma()->XDMAC_GS & (XDMAC_GS_ST0 << xdmaRxChannelNumber());
+            disableRx();
+            // wait for the channel to actually stop (and flush)
+            while (xdma()->XDMAC_GS & (XDMAC_GS_ST0 << xdmaRxChannelNumber())) { ; }
+            SamCommon::sync();
+
+            if (xdmaRxChannel()->XDMAC_CDA != (uint32_t)expected_position) {
+                if (was_running) { enableRx(); }
+                return false;
+            }
+            return true;
+        };
+        // Restart a transfer stopped by holdRx() count bytes back, so the next bytes received overwrite those.
+        // If enable is false it's moved back but left stopped, for enableRx() later. count must not be 0.
+        void releaseRx(const uint32_t count, const bool enable = true) const
+        {
+            const uint32_t left = xdmaRxChannel()->XDMAC_CUBC;
+            xdmaRxChannel()->XDMAC_CDA = xdmaRxChannel()->XDMAC_CDA - count;
+            xdmaRxChannel()->XDMAC_CUBC = left + count;
+            SamCommon::sync();
+            if (enable) { enableRx(); }
+        };
+
 
         // Bundle it all up
         bool startRXTransfer(void * const buffer,
@@ -40,6 +40,9 @@
 #include "SamSPIInternal.h"
 #include "SamSPIDMA.h"
 
+// USARTs in SPI master mode share the USART register info, DMA, and interrupt vectors
+#include "MotateUART.h"
+
 namespace Motate {
     template<int8_t spiPeripheralNumber>
     struct _SPIHardware : Motate::SPI_internal::SPIInfo<spiPeripheralNumber>
@@ -480,6 +483,600 @@ namespace Motate {
         // TODO
     };
 
+#pragma mark _USARTSPIHardware
+    /**************************************************
+     *
+     * USART in SPI master mode, with the same interface as _SPIHardware
+     *
+     * SPI pins with an spiNum of 4 and up are on USART (spiNum - 4), just like the
+     * UART pins use 4 and up for the UARTs. SPIGetHardware picks this for them.
+     *
+     * The USART only has one chip select (the RTS pin), which we force low for the
+     * whole message with FCS and release with RCS in deassert(). There are no
+     * per-channel registers, so the US_MR and US_BRGR values for each channel are
+     * kept here (the way _SPIHardware keeps them in SPI_CSR[channel]) and loaded
+     * into the USART in setChannel when the device being selected needs them.
+     *
+     **************************************************/
+
+    template<uint8_t usartPeripheralNumber>
+    struct _USARTSPIHardware : UART_internal::USARTInfo<usartPeripheralNumber>
+    {
+        using this_type_t = _USARTSPIHardware<usartPeripheralNumber>;
+        using info = UART_internal::USARTInfo<usartPeripheralNumber>;
+
+        static_assert(info::exists,
+                "USART used as an SPI bus doesn't exist on this processor.");
+
+        static constexpr Usart * const usart() {
+            return info::usart;
+        };
+        using info::peripheralId;
+        static constexpr auto spiIRQ = info::IRQ;
+        static constexpr auto spiPeripheralNum = 4 + usartPeripheralNumber;
+
+        std::function<void(Interrupt::Type)> _spiInterruptHandler;
+
+        DMA<Usart *, usartPeripheralNumber> dma {_spiInterruptHandler};
+
+        // The USART requires a CD of at least 6 in SPI master mode
+        static constexpr uint32_t kMinimumDivider = 6;
+
+        // Same channel numbering as SPI_CSR[] in _SPIHardware
+        static constexpr uint8_t kChannelCount = 4;
+
+        // US_MR and US_BRGR values for each channel, set by setChannelOptions()
+        uint32_t _mode_registers[kChannelCount] = {};
+        uint32_t _baud_registers[kChannelCount] = {};
+
+        _USARTSPIHardware() {
+            SamCommon::enablePeripheralClock(peripheralId);
+
+            // Reset and disable TX and RX
+            usart()->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_RXDIS | US_CR_TXDIS | US_CR_RSTSTA;
+        };
+
+        void init() {
+            SamCommon::enablePeripheralClock(peripheralId);
+
+            // Disable all interrupts
+            usart()->US_IDR = 0xffffffff;
+
+            // Put it in SPI master mode now, so SCK and NSS are driven idle
+            usart()->US_MR = static_cast<uint32_t>(USART_MODE_t::SPI_MASTER) | static_cast<uint32_t>(USCLKS_t::MCK) |
+                             static_cast<uint32_t>(CHRL_t::CH_8_BIT) | US_MR_CLKO;
+            usart()->US_CR = US_CR_RCS;
+
+            // setup interrupt handlers BEFORE setting up DMA, in case it causes an interrupt
+            // we share the interrupt vector with the UART for this USART
+            _USARTHardware<usartPeripheralNumber>::_uartInterruptHandlerJumper = [&]() {
+                if (_spiInterruptHandler) {
+                    _spiInterruptHandler(getInterruptCause());
+                } else {
+#if IN_DEBUGGER == 1
+                    __asm__("BKPT");
+#endif
+                }
+            };
+            setInterrupts(Interrupt::PriorityLow);
+            dma.reset();
+            dma.setInterrupts(Interrupt::PriorityLow);
+        };
+
+        // There's only one CS, so there's nothing to decode
+        void setUsingCSDecoder(bool decoder) {
+#if IN_DEBUGGER == 1
+            if (decoder) {
+                __asm__("BKPT"); // USART SPI cannot use a CS decoder
+            }
+#endif
+        }
+
+        void enable() {
+            usart()->US_CR = US_CR_TXEN | US_CR_RXEN;
+        };
+
+        void disable() {
+            usart()->US_CR = US_CR_TXDIS | US_CR_RXDIS;
+        };
+
+        void deassert() {
+            usart()->US_CR = US_CR_RCS;
+        }
+
+        const SPIBusDeviceBase*  current_device = nullptr;
+
+        bool setChannel(const SPIBusDeviceBase* const device, const bool deassert_after = false) {
+            // if we are transmitting, we cannot switch
+            while (!(usart()->US_CSR & US_CSR_TXEMPTY)) {
+                ;
+            }
+
+            current_device = device;
+
+            auto channel_num = device->getChannel();
+            if (channel_num >= kChannelCount) {
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // channel out of range
+#endif
+                channel_num = 0;
+            }
+
+            if ((usart()->US_MR != _mode_registers[channel_num]) || (usart()->US_BRGR != _baud_registers[channel_num])) {
+                disable();
+                usart()->US_MR   = _mode_registers[channel_num];
+                usart()->US_BRGR = _baud_registers[channel_num];
+            }
+
+            // drop anything left over, so the RX DMA starts with the first byte of this message
+            usart()->US_CR = US_CR_RSTRX;
+
+            usart()->US_CR = US_CR_FCS;
+
+            enable();
+            return true;
+        }
+
+        void setChannelOptions(const uint8_t channel, const uint32_t baud, const uint16_t options, uint32_t min_between_cs_delay_ns, uint32_t cs_to_sck_delay_ns, uint32_t between_word_delay_ns) {
+            if (channel >= kChannelCount) {
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // channel out of range
+#endif
+                return;
+            }
+
+            // We want the closest match *below* the value asked for. It's safer to be too slow.
+            uint32_t divider = (SamCommon::getPeripheralClockFreq() + baud - 1) / baud;
+            if (divider > 0xffff) {
+                divider = 0xffff;
+            } else if (divider < kMinimumDivider) {
+                divider = kMinimumDivider;
+            }
+
+            uint32_t new_mode = static_cast<uint32_t>(USART_MODE_t::SPI_MASTER) | static_cast<uint32_t>(USCLKS_t::MCK) | US_MR_CLKO;
+
+            if (options & kSPIPolarityReversed) {
+                new_mode |= US_MR_CPOL;
+            }
+
+            // USART CPHA has the same meaning as SPI NCPHA
+            if (!(options & kSPIClockPhaseReversed)) {
+                new_mode |= US_MR_CPHA;
+            }
+
+            switch (options & kSPIBitsMask) {
+                case kSPI9Bit:
+                    new_mode |= US_MR_MODE9;
+                    break;
+
+                case kSPI8Bit:
+                    new_mode |= static_cast<uint32_t>(CHRL_t::CH_8_BIT);
+                    break;
+
+                default:
+                    // Only 8 and 9 bits are supported by the USART
+#if IN_DEBUGGER == 1
+                    __asm__("BKPT");
+#endif
+                    new_mode |= static_cast<uint32_t>(CHRL_t::CH_8_BIT);
+                    break;
+            }
+
+            // The USART has no equivalent to DLYBCS, DLYBS, or DLYBCT. NSS is asserted one bit
+            // time before the first clock and released one bit time after the last, and there
+            // are no gaps between DMA-fed words.
+
+            _mode_registers[channel] = new_mode;
+            _baud_registers[channel] = US_BRGR_CD(divider);
+        };
+
+        void setInterruptHandler(std::function<void(Interrupt::Type)> &&handler) {
+            _spiInterruptHandler = std::move(handler);
+        }
+
+        Interrupt::Type getInterruptCause() {
+            Interrupt::Type status = SPIInterrupt::Unknown;
+
+            // See _SPIHardware::getInterruptCause() for why we check the mask as well
+            auto US_CSR_hold = usart()->US_CSR;
+            auto US_IMR_hold = usart()->US_IMR;
+
+            if ((US_IMR_hold & US_IMR_TXRDY) && (US_CSR_hold & US_CSR_TXRDY))
+            {
+                status |= SPIInterrupt::OnTxReady;
+            }
+            if ((US_IMR_hold & US_IMR_RXRDY) && (US_CSR_hold & US_CSR_RXRDY))
+            {
+                status |= SPIInterrupt::OnRxReady;
+            }
+
+            if (dma.inTxBufferEmptyInterrupt())
+            {
+                status |= SPIInterrupt::OnTxTransferDone;
+            }
+            if (dma.inRxBufferFullInterrupt())
+            {
+                status |= SPIInterrupt::OnRxTransferDone;
+            }
+            return status;
+        }
+
+        void setInterrupts(const Interrupt::Type interrupts) {
+            if (interrupts != SPIInterrupt::Off) {
+
+                if (interrupts & SPIInterrupt::OnTxReady) {
+                    usart()->US_IER = US_IER_TXRDY;
+                } else {
+                    usart()->US_IDR = US_IDR_TXRDY;
+                }
+                if (interrupts & SPIInterrupt::OnRxReady) {
+                    usart()->US_IER = US_IER_RXRDY;
+                } else {
+                    usart()->US_IDR = US_IDR_RXRDY;
+                }
+
+                if (interrupts & SPIInterrupt::OnRxTransferDone) {
+                    dma.startRxDoneInterrupts();
+                } else {
+                    dma.stopRxDoneInterrupts();
+                }
+                if (interrupts & SPIInterrupt::OnTxTransferDone) {
+                    dma.startTxDoneInterrupts();
+                } else {
+                    dma.stopTxDoneInterrupts();
+                }
+
+                /* Set interrupt priority */
+                if (interrupts & SPIInterrupt::PriorityHighest) {
+                    NVIC_SetPriority(spiIRQ, 0);
+                }
+                else if (interrupts & SPIInterrupt::PriorityHigh) {
+                    NVIC_SetPriority(spiIRQ, 1);
+                }
+                else if (interrupts & SPIInterrupt::PriorityMedium) {
+                    NVIC_SetPriority(spiIRQ, 2);
+                }
+                else if (interrupts & SPIInterrupt::PriorityLow) {
+                    NVIC_SetPriority(spiIRQ, 3);
+                }
+                else if (interrupts & SPIInterrupt::PriorityLowest) {
+                    NVIC_SetPriority(spiIRQ, 4);
+                }
+
+                NVIC_EnableIRQ(spiIRQ);
+            } else {
+
+                NVIC_DisableIRQ(spiIRQ);
+            }
+        };
+
+        void _enableOnTXTransferDoneInterrupt() {
+            dma.startTxDoneInterrupts();
+        };
+
+        void _disableOnTXTransferDoneInterrupt() {
+            dma.stopTxDoneInterrupts();
+        };
+
+        void _enableOnRXTransferDoneInterrupt() {
+            dma.startRxDoneInterrupts();
+        };
+
+        void _disableOnRXTransferDoneInterrupt() {
+            dma.stopRxDoneInterrupts();
+        };
+
+        uint8_t getMessageSlotsAvailable() {
+            uint8_t count = 0;
+            if (dma.doneWriting() && dma.doneReading()) { count++; }
+            return count;
+        };
+
+        bool doneWriting() {
+            return dma.doneWriting();
+        };
+        bool doneReading() {
+            return dma.doneReading();
+        };
+
+        // start transfer of message
+        bool startTransfer(uint8_t *tx_buffer, uint8_t *rx_buffer, uint16_t size) {
+            bool rx_is_setup = false;
+            bool tx_is_setup = false;
+            const bool handle_interrupts = true;
+            const bool include_next = false;
+
+            if (current_device == nullptr) {
+                return false;
+            }
+            uint8_t byte_width = (usart()->US_MR & US_MR_MODE9) ? 2 : 1;
+
+            dma.setInterrupts(Interrupt::Off);
+            rx_is_setup = dma.startRXTransfer(rx_buffer, size, handle_interrupts, include_next, byte_width);
+            if (!rx_is_setup) { return false; } // fail early
+            tx_is_setup = dma.startTXTransfer(tx_buffer, size, handle_interrupts, include_next, byte_width);
+
+            if (rx_is_setup || tx_is_setup) {
+                enable();
+#ifdef IN_DEBUGGER
+            } else {
+                __asm__("BKPT"); // no transfer setup
+#endif
+            }
+            return rx_is_setup | tx_is_setup;
+        }
+    };
+
+#pragma mark _SPISlaveHardware
+    /**************************************************
+     *
+     * SPI peripheral in slave mode, used by SPISlave
+     *
+     * Neither the XDMAC nor the DMAC code here can chain a second buffer, so the
+     * double-buffering is done here: each direction has an active region and one
+     * queued "next" region, which is started from the DMA transfer-done interrupt
+     * before the upper layers are told. The gap is only the interrupt latency, and
+     * the SPI holds one character while we get there.
+     *
+     * NSS must be the NPCS0 pin. The SPI flags the NSS rising edge, which we pass up
+     * as SPIInterrupt::OnCSDeasserted so the upper layers can find message framing.
+     *
+     **************************************************/
+
+    template<int8_t spiPeripheralNumber>
+    struct _SPISlaveHardware : Motate::SPI_internal::SPIInfo<spiPeripheralNumber>
+    {
+        using this_type_t = _SPISlaveHardware<spiPeripheralNumber>;
+        using info = Motate::SPI_internal::SPIInfo<spiPeripheralNumber>;
+
+        static_assert(info::exists,
+                "Only _SPISlaveHardware<0> or _SPISlaveHardware<1> is valid on this processor.");
+
+        using info::spi;
+        using info::peripheralId;
+        static constexpr auto spiIRQ = info::IRQ;
+        static constexpr auto spiPeripheralNum = spiPeripheralNumber;
+
+        std::function<void(Interrupt::Type)> _spiInterruptHandler;
+
+        // the DMA calls this one, so we can start the queued region before passing it up
+        std::function<void(Interrupt::Type)> _dmaInterruptHandler;
+
+        DMA<SPI_tag, spiPeripheralNumber> dma {_dmaInterruptHandler};
+
+        struct _Region {
+            char     *start  = nullptr;
+            uint16_t  length = 0;
+
+            char *end() const { return start + length; };
+            bool contains(const char *p) const { return (p >= start) && (p < end()); };
+        };
+
+        _Region _rx_active;
+        _Region _rx_next;
+        _Region _tx_active;
+        _Region _tx_next;
+
+        _SPISlaveHardware() {
+            SamCommon::enablePeripheralClock(peripheralId);
+
+            // Softare reset of SPI module
+            spi->SPI_CR = SPI_CR_SWRST;
+            disable();
+        };
+
+        void init() {
+            // Slave mode (MSTR = 0), everything else is ignored in slave mode
+            spi->SPI_MR = 0;
+
+            // Disable all interrupts
+            spi->SPI_IDR = 0x7FF;
+
+            // setup interrupt handlers BEFORE setting up DMA, in case it causes an interrupt
+            // we share the interrupt vector with the master mode hardware
+            _SPIHardware<spiPeripheralNumber>::_spiInterruptHandlerJumper = [&]() {
+                auto cause = getInterruptCause();
+                if (cause & (SPIInterrupt::OnRxTransferDone | SPIInterrupt::OnTxTransferDone)) {
+                    _dmaInterruptHandler(cause);
+                } else if (_spiInterruptHandler) {
+                    _spiInterruptHandler(cause);
+                } else {
+#if IN_DEBUGGER == 1
+                    __asm__("BKPT");
+#endif
+                }
+            };
+            _dmaInterruptHandler = [&](Interrupt::Type cause) {
+                if (cause & SPIInterrupt::OnRxTransferDone) { _startNextRX(); }
+                if (cause & SPIInterrupt::OnTxTransferDone) { _startNextTX(); }
+                if (_spiInterruptHandler) {
+                    _spiInterruptHandler(cause);
+                }
+            };
+            dma.reset();
+        };
+
+        void setOptions(const uint16_t options) {
+            uint32_t new_otions = 0;
+
+            if (options & kSPIPolarityReversed) {
+                new_otions |= SPI_CSR_CPOL;
+            }
+            if (!(options & kSPIClockPhaseReversed)) {
+                new_otions |= SPI_CSR_NCPHA;
+            }
+
+            // only 8 bit is supported by the char buffers we DMA into
+            new_otions |= SPI_CSR_BITS_8_BIT;
+
+            // In slave mode, only CSR[0] is used
+            spi->SPI_CSR[0] = new_otions;
+        };
+
+        void enable() {
+            spi->SPI_CR = SPI_CR_SPIEN ;
+        };
+
+        void disable() {
+            spi->SPI_CR = SPI_CR_SPIDIS;
+        };
+
+        void setInterruptHandler(std::function<void(Interrupt::Type)> &&handler) {
+            _spiInterruptHandler = std::move(handler);
+        }
+
+        Interrupt::Type getInterruptCause() {
+            Interrupt::Type status = SPIInterrupt::Unknown;
+
+            // See _SPIHardware::getInterruptCause() for why we check the mask as well.
+            // Note that reading SPI_SR clears NSSR, OVRES, and UNDES.
+            auto SPI_SR_hold = spi->SPI_SR;
+            auto SPI_IMR_hold = spi->SPI_IMR;
+
+            if ((SPI_IMR_hold & SPI_IMR_NSSR) && (SPI_SR_hold & SPI_SR_NSSR))
+            {
+                status |= SPIInterrupt::OnCSDeasserted;
+            }
+            if ((SPI_IMR_hold & SPI_IMR_OVRES) && (SPI_SR_hold & SPI_SR_OVRES))
+            {
+                status |= SPIInterrupt::OnRxError;
+            }
+            if ((SPI_IMR_hold & SPI_IMR_UNDES) && (SPI_SR_hold & SPI_SR_UNDES))
+            {
+                status |= SPIInterrupt::OnTxError;
+            }
+
+            if (dma.inTxBufferEmptyInterrupt())
+            {
+                status |= SPIInterrupt::OnTxTransferDone;
+            }
+            if (dma.inRxBufferFullInterrupt())
+            {
+                status |= SPIInterrupt::OnRxTransferDone;
+            }
+            return status;
+        }
+
+        void setInterrupts(const Interrupt::Type interrupts) {
+            if (interrupts != SPIInterrupt::Off) {
+
+                if (interrupts & SPIInterrupt::OnCSDeasserted) {
+                    spi->SPI_IER = SPI_IER_NSSR;
+                } else {
+                    spi->SPI_IDR = SPI_IDR_NSSR;
+                }
+                if (interrupts & SPIInterrupt::OnRxError) {
+                    spi->SPI_IER = SPI_IER_OVRES;
+                } else {
+                    spi->SPI_IDR = SPI_IDR_OVRES;
+                }
+                if (interrupts & SPIInterrupt::OnTxError) {
+                    spi->SPI_IER = SPI_IER_UNDES;
+                } else {
+                    spi->SPI_IDR = SPI_IDR_UNDES;
+                }
+
+                // The DMA shares the priority, and uses the transfer-done interrupts as needed
+                dma.setInterrupts(interrupts & ~(SPIInterrupt::OnRxTransferDone | SPIInterrupt::OnTxTransferDone));
+
+                /* Set interrupt priority */
+                if (interrupts & SPIInterrupt::PriorityHighest) {
+                    NVIC_SetPriority(spiIRQ, 0);
+                }
+                else if (interrupts & SPIInterrupt::PriorityHigh) {
+                    NVIC_SetPriority(spiIRQ, 1);
+                }
+                else if (interrupts & SPIInterrupt::PriorityMedium) {
+                    NVIC_SetPriority(spiIRQ, 2);
+                }
+                else if (interrupts & SPIInterrupt::PriorityLow) {
+                    NVIC_SetPriority(spiIRQ, 3);
+                }
+                else if (interrupts & SPIInterrupt::PriorityLowest) {
+                    NVIC_SetPriority(spiIRQ, 4);
+                }
+
+                NVIC_EnableIRQ(spiIRQ);
+            } else {
+
+                NVIC_DisableIRQ(spiIRQ);
+            }
+        };
+
+        // Start a transfer into buffer, or queue it behind the active one.
+        // If buffer starts inside the active region (the owner computed it from the
+        // current position), only the part past the end of the active region is added.
+        // Returns false if there's no room to start or queue it.
+        bool startRXTransfer(char *buffer, uint16_t length) {
+            SamCommon::InterruptDisabler disabler;
+
+            if (dma.doneReading()) {
+                _rx_next = _Region{};
+                _rx_active = _Region{buffer, length};
+                return dma.startRXTransfer(buffer, length, /*handle_interrupts:*/ true, /*include_next:*/ false);
+            }
+
+            if (_rx_active.contains(buffer)) {
+                if (buffer + length <= _rx_active.end()) { return true; } // already covered
+                length -= _rx_active.end() - buffer;
+                buffer  = _rx_active.end();
+            }
+
+            if (_rx_next.length != 0) { return false; }
+            _rx_next = _Region{buffer, length};
+            return true;
+        };
+
+        bool startTXTransfer(char *buffer, uint16_t length) {
+            SamCommon::InterruptDisabler disabler;
+
+            if (dma.doneWriting()) {
+                _tx_next = _Region{};
+                _tx_active = _Region{buffer, length};
+                return dma.startTXTransfer(buffer, length, /*handle_interrupts:*/ true, /*include_next:*/ false);
+            }
+
+            if (_tx_next.length != 0) { return false; }
+            _tx_next = _Region{buffer, length};
+            return true;
+        };
+
+        // called from the DMA interrupt
+        void _startNextRX() {
+            _rx_active = _rx_next;
+            _rx_next = _Region{};
+            if (_rx_active.length) {
+                dma.startRXTransfer(_rx_active.start, _rx_active.length, /*handle_interrupts:*/ true, /*include_next:*/ false);
+            } else {
+                dma.stopRxDoneInterrupts();
+            }
+        };
+
+        void _startNextTX() {
+            _tx_active = _tx_next;
+            _tx_next = _Region{};
+            if (_tx_active.length) {
+                dma.startTXTransfer(_tx_active.start, _tx_active.length, /*handle_interrupts:*/ true, /*include_next:*/ false);
+            } else {
+                dma.stopTxDoneInterrupts();
+            }
+        };
+
+        char* getRXTransferPosition() {
+            return (char *)dma.getRXTransferPosition();
+        };
+
+        char* getTXTransferPosition() {
+            return (char *)dma.getTXTransferPosition();
+        };
+
+        void flushRead() {
+            SamCommon::InterruptDisabler disabler;
+            _rx_next = _Region{};
+            dma.flushRead();
+        };
+    };
+
     template <pin_number csBit0PinNumber, pin_number csBit1PinNumber, pin_number csBit2PinNumber, pin_number csBit3PinNumber>
     struct SPIChipSelectPinMux {
         // These pins may be null, but if they're not, they must be valid CS pins
@@ -541,9 +1138,17 @@ namespace Motate {
     };
 
 
-    // SPIGetHardware is just a pass-through for now
+    // SPI numbers 0-3 are SPI peripherals, 4 and up are USARTs in SPI mode
+    template<uint8_t spiPeripheralNumber>
+    using _SPI_Or_USART = typename std::conditional< (spiPeripheralNumber < 4), _SPIHardware<spiPeripheralNumber>, _USARTSPIHardware<spiPeripheralNumber-4>>::type;
+
+    // SPIBus has already verified that all three pins are on the same spiNum
+    template <pin_number spiMISOPinNumber, pin_number spiMOSIPinNumber, pin_number spiSCKPinNumber>
+    using SPIGetHardware = _SPI_Or_USART<SPIMISOPin<spiMISOPinNumber>::spiNum>;
+
+    // Slave mode is only supported on the SPI peripherals
     template <pin_number spiMISOPinNumber, pin_number spiMOSIPinNumber, pin_number spiSCKPinNumber>
-    using SPIGetHardware = _SPIHardware<SPIMISOPin<spiMISOPinNumber>::spiNum>;
+    using SPISlaveGetHardware = _SPISlaveHardware<SPIMISOPin<spiMISOPinNumber>::spiNum>;
 }
 
 #endif /* end of include guard: SAMSPI_H_ONCE */
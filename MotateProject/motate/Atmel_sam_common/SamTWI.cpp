@@ -37,10 +37,20 @@ namespace Motate {
     #if defined(HAS_TWIHS1) || defined(HAS_TWI1)
     template<> TWIHardware_<1u>* TWIHardware_<1u>::twiInterruptHandler_ = nullptr;
     #endif
+    #if defined(HAS_TWIHS0)
+    template<> TWISlaveHardware_<0u>* TWISlaveHardware_<0u>::twiInterruptHandler_ = nullptr;
+    #endif
+    #if defined(HAS_TWIHS1)
+    template<> TWISlaveHardware_<1u>* TWISlaveHardware_<1u>::twiInterruptHandler_ = nullptr;
+    #endif
 }
 
 #ifdef HAS_TWIHS0
 extern "C" void TWIHS0_Handler(void)  {
+    if (Motate::TWISlaveHardware_<0u>::twiInterruptHandler_) {
+        Motate::TWISlaveHardware_<0u>::twiInterruptHandler_->handleInterrupts();
+        return;
+    }
     if (Motate::TWIHardware_<0u>::twiInterruptHandler_) {
         Motate::TWIHardware_<0u>::twiInterruptHandler_->handleInterrupts();
         return;
@@ -53,6 +63,10 @@ extern "C" void TWIHS0_Handler(void)  {
 
 #ifdef HAS_TWIHS1
 extern "C" void TWIHS1_Handler(void)  {
+    if (Motate::TWISlaveHardware_<1u>::twiInterruptHandler_) {
+        Motate::TWISlaveHardware_<1u>::twiInterruptHandler_->handleInterrupts();
+        return;
+    }
     if (Motate::TWIHardware_<1u>::twiInterruptHandler_) {
         Motate::TWIHardware_<1u>::twiInterruptHandler_->handleInterrupts();
         return;
@@ -56,6 +56,10 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
     using info::peripheralId;
     using info::IRQ;
 
+    // uint32_t setClock(speed, rise_time_ns, hold_time_ns) returns the achieved speed (or 0)
+    using info::setClock;
+    using info::kMaxMasterSpeed;
+
     TWIInterruptHandler* externalTWIInterruptHandler_;
 
     std::function<void(Interrupt::Type)> TWIDMAInterruptHandler_;
@@ -269,6 +273,8 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
     enum class InternalState {
         Idle,
 
+        TXSendingCommand,
+
         TXReadyToSendFirstByte,
         TXSendingFirstByte,
         TXDMAStarted,
@@ -290,6 +296,9 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
     uint8_t* local_buffer_ptr_  = nullptr;
     uint16_t local_buffer_size_ = 0;
 
+    uint8_t* command_ptr_  = nullptr;
+    uint16_t command_size_ = 0;
+
     // start transfer of message
     bool startTransfer(uint8_t* buffer, const uint16_t size, const bool is_rx) {
         if ((buffer == nullptr) || (state_ != InternalState::Idle) || (size == 0)) {
@@ -305,29 +314,8 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
             local_buffer_ptr_  = buffer;
             local_buffer_size_ = size;
 
-            // tell the peripheral that we're reading
             // (Note that internal address mode MIGHT actually write first!)
-            this->setReading();
-            this->enableOnNACKInterrupt();
-            this->enableOnRXReadyInterrupt();
-            if (local_buffer_size_ == 1) {
-                // "last char" is the only char
-                state_ = InternalState::RXWaitingForLastChar;
-
-                // If this is the only character to read, tell it to NACK at the end of this read
-                // and tart the reading transaction
-                this->setStartStop();
-            } else if (local_buffer_size_ > 2) {
-                state_ = InternalState::RXReadingFirstByte;
-
-                // Start the reading transaction
-                this->setStart();
-            } else {  // local_buffer_size_ == 2
-                state_ = InternalState::RXWaitingForRXReady;  // this will pick up below
-
-                // Start the reading transaction
-                this->setStart();
-            }
+            startReading_();
 
             TWIInterruptCause empty_cause;
             prehandleInterrupt(empty_cause);  // ignore return value
@@ -347,6 +335,63 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
         return true;
     }
 
+    // start a write of command, then a repeated START and a read into buffer
+    // the command is sent a byte at a time from TXReady, since it's expected to be short
+    bool startWriteThenReadTransfer(uint8_t* command, const uint16_t command_size, uint8_t* buffer, const uint16_t size) {
+        if ((command == nullptr) || (command_size == 0)) {
+            return startTransfer(buffer, size, /*is_rx:*/ true);
+        }
+        if ((buffer == nullptr) || (state_ != InternalState::Idle) || (size == 0)) {
+#if IN_DEBUGGER == 1
+            __asm__("BKPT");
+#endif
+            return false;
+        }
+
+        dma.setInterrupts(Interrupt::Off);
+
+        command_ptr_       = command;
+        command_size_      = command_size;
+        local_buffer_ptr_  = buffer;
+        local_buffer_size_ = size;
+
+        state_ = InternalState::TXSendingCommand;
+
+        // tell the peripheral that we're writing, and the first TXReady will start it
+        this->setWriting();
+        this->enableOnTXReadyInterrupt();
+        this->enableOnNACKInterrupt();
+
+        return true;
+    }
+
+    // setup the peripheral for reading local_buffer_size_ bytes, and START
+    // (if we're in the middle of a write without a STOP, this is a repeated START)
+    void startReading_() {
+        // tell the peripheral that we're reading
+        this->setReading();
+        this->enableOnNACKInterrupt();
+        this->enableOnRXReadyInterrupt();
+        if (local_buffer_size_ == 1) {
+            // "last char" is the only char
+            state_ = InternalState::RXWaitingForLastChar;
+
+            // If this is the only character to read, tell it to NACK at the end of this read
+            // and tart the reading transaction
+            this->setStartStop();
+        } else if (local_buffer_size_ > 2) {
+            state_ = InternalState::RXReadingFirstByte;
+
+            // Start the reading transaction
+            this->setStart();
+        } else {  // local_buffer_size_ == 2
+            state_ = InternalState::RXWaitingForRXReady;  // this will pick up below
+
+            // Start the reading transaction
+            this->setStart();
+        }
+    }
+
 
     bool prehandleInterrupt(TWIInterruptCause& cause) {
         // return true if we are done with the transaction
@@ -394,6 +439,36 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
             return false;
         }
 
+        // Write-then-read command cases
+
+        if (InternalState::TXSendingCommand == state_ && cause.isNACK()) {
+            this->disableOnTXReadyInterrupt();
+            this->disableOnNACKInterrupt();
+            command_ptr_ = nullptr;
+
+            state_ = InternalState::TXError;
+            cause.setTxError();
+        }  // no else here!
+
+        if (InternalState::TXSendingCommand == state_ && cause.isTxReady()) {
+            cause.clearTxReady();  // stop this from being propagated
+
+            if (command_size_ > 0) {
+                this->transmitChar(*command_ptr_);
+                ++command_ptr_;
+                --command_size_;
+
+                return false;  // nothing more to do until the next TXReady
+            }
+
+            // The last command byte is out of THR and no STOP was requested, so the bus is
+            // held for us. Turn it around with a repeated START, and the RX cases pick up below.
+            this->disableOnTXReadyInterrupt();
+            command_ptr_ = nullptr;
+
+            startReading_();
+        }  // no else here!
+
         // RX cases
 
 
@@ -671,10 +746,212 @@ struct TWIHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber>
     // TODO
     };
 
+#pragma mark TWISlaveHardware_
+    /**************************************************
+     *
+     * TWI peripheral as an I2C slave, serving a register map.
+     *
+     * The protocol is the common one for register-based devices:
+     *  - A write sets the register pointer with its first byte, and any further bytes are
+     *    stored starting at the pointer.
+     *  - A read (usually after a repeated START) sends from the pointer onward.
+     *
+     * After the address match and the pointer byte, the data moves by DMA straight to or from
+     * the map, so the CPU only sees the start and end of each access. Reads past the end of the
+     * map are padded with 0xFF.
+     *
+     * When a write access ends (by STOP, or a repeated START into a read), the written range is
+     * passed to the handler's handleTWISlaveWrite(). The pointer is left where the write ended.
+     *
+     * SCLWS is set every time the clock is held waiting on the DMA, so it's only listened to when
+     * it means something: while a read's DMA is running it's off, and it's turned on by the DMA
+     * done interrupt to pad past the end of the map. While a write's DMA is running it has to stay
+     * on, since a clock held with SVREAD set is the only sign of a repeated START into a read.
+     *
+     **************************************************/
+
+    template <int8_t twiPeripheralNumber>
+    struct TWISlaveHardware_ : public Motate::TWI_internal::TWIInfo<twiPeripheralNumber> {
+        using this_type_t                      = TWISlaveHardware_<twiPeripheralNumber>;
+        using info                             = Motate::TWI_internal::TWIInfo<twiPeripheralNumber>;
+        static constexpr auto twiPeripheralNum = twiPeripheralNumber;
+
+        static_assert(info::exists, "Using an unsupported TWI peripheral for this processor.");
+        static_assert(info::kSupportsSlave, "TWI slave mode is not supported on this processor.");
+
+        using info::twi;
+        using info::peripheralId;
+        using info::IRQ;
+
+        TWISlaveInterruptHandler* externalTWISlaveInterruptHandler_ = nullptr;
+
+        // the DMA interrupt is only used to know when a read has run off the end of the map
+        std::function<void(Interrupt::Type)> TWIDMAInterruptHandler_;
+        static this_type_t                  *twiInterruptHandler_;
+
+        DMA<TWI_tag, twiPeripheralNumber> dma{TWIDMAInterruptHandler_};
+
+        uint8_t* registers_      = nullptr;
+        uint16_t registers_size_ = 0;
+        uint16_t pointer_        = 0;  // the register pointer
+        uint16_t write_start_    = 0;
+
+        enum class InternalState {
+            Idle,
+            WaitingForPointer,
+            Writing,
+            Reading,
+        };
+
+        std::atomic<InternalState> state_ = InternalState::Idle;
+
+        TWISlaveHardware_() : TWIDMAInterruptHandler_{[&](Interrupt::Type hint) { this->handleDMAInterrupts(hint); }} {
+            twiInterruptHandler_ = this;
+            SamCommon::enablePeripheralClock(peripheralId);
+
+            // read the status register (Microchip says so)
+            this->getSR();
+
+            // Softare reset of TWI module
+            this->resetModule();
+
+            this->disable();
+        }
+
+        void init(const uint8_t address, uint8_t* registers, const uint16_t registers_size) {
+            registers_      = registers;
+            registers_size_ = registers_size;
+            pointer_        = 0;
+
+            dma.reset();
+            dma.setInterrupts(Interrupt::Off);
+
+            this->enableSlave(address);
+
+            state_ = InternalState::Idle;
+            this->enableOnSlaveAccessInterrupt();
+
+            // always have IRQs enabled for TWI
+            NVIC_SetPriority(IRQ, 1);
+            NVIC_EnableIRQ(IRQ);
+        }
+
+        void setInterruptHandler(TWISlaveInterruptHandler* handler) { externalTWISlaveInterruptHandler_ = handler; }
+
+        void handleInterrupts() {
+            auto sr  = this->getSR();  // clears EOSACC and NACK
+            auto imr = this->getIMR();
+
+            if ((InternalState::Idle == state_) && this->isSlaveAccess(sr)) {
+                // SVACC stays set for the whole access, so we stop listening to it until the end
+                this->disableOnSlaveAccessInterrupt();
+                this->enableOnEndOfSlaveAccessInterrupt();
+                // in case a late DMA interrupt from the last access turned it on
+                this->disableOnClockWaitInterrupt();
+
+                if (this->isSlaveRead(sr)) {
+                    startReading_();
+                } else {
+                    state_ = InternalState::WaitingForPointer;
+                    this->enableOnRXReadyInterrupt();
+                }
+            }
+
+            if ((InternalState::WaitingForPointer == state_) && this->isRxReady(sr)) {
+                pointer_ = this->readByte();
+                if (pointer_ >= registers_size_) {
+                    pointer_ = 0;
+                }
+                this->disableOnRXReadyInterrupt();
+
+                state_       = InternalState::Writing;
+                write_start_ = pointer_;
+
+                dma.startRXTransfer(registers_ + pointer_, registers_size_ - pointer_, /*handle_interrupts:*/ false);
+
+                // If the master turns around to read, or writes past the end, the clock is held
+                this->enableOnClockWaitInterrupt();
+            }
+
+            if ((InternalState::Writing == state_) && this->isClockWaitEnabled(imr) && this->isClockWait(sr)) {
+                if (this->isSlaveRead(sr)) {
+                    // repeated START into a read
+                    finishWriting_();
+                    startReading_();
+                } else if (dma.doneReading()) {
+                    // writing past the end of the map, drop it
+                    this->readByte();
+                }
+            }
+
+            if ((InternalState::Reading == state_) && this->isClockWaitEnabled(imr) && this->isClockWait(sr)) {
+                if (dma.doneWriting()) {
+                    // reading past the end of the map
+                    this->transmitChar(0xFF);
+                }
+            }
+
+            if ((InternalState::Idle != state_) && this->isEndOfSlaveAccess(sr)) {
+                if (InternalState::Writing == state_) {
+                    finishWriting_();
+                } else if (InternalState::Reading == state_) {
+                    dma.stopTxDoneInterrupts();
+                    dma.disableTx();
+                }
+
+                this->disableOnRXReadyInterrupt();
+                this->disableOnClockWaitInterrupt();
+                this->disableOnEndOfSlaveAccessInterrupt();
+
+                state_ = InternalState::Idle;
+                this->enableOnSlaveAccessInterrupt();
+            }
+        }
+
+        void startReading_() {
+            state_ = InternalState::Reading;
+
+            // the clock is held until the DMA loads the first byte, which isn't worth an interrupt
+            this->disableOnClockWaitInterrupt();
+
+            // the last read may have been cut short, so don't wait for the DMA to be done
+            dma.disableTx();
+            dma.setTx(registers_ + pointer_, registers_size_ - pointer_);
+            dma.startTxDoneInterrupts();
+            dma.enableTx();
+        }
+
+        // Called from the DMA interrupt
+        void handleDMAInterrupts(const Interrupt::Type hint) {
+            if ((hint & Interrupt::OnTxTransferDone) && (InternalState::Reading == state_)) {
+                dma.stopTxDoneInterrupts();
+                // anything more the master reads is past the end of the map
+                this->enableOnClockWaitInterrupt();
+            }
+        }
+
+        void finishWriting_() {
+            dma.disableRx();
+
+            const uint16_t written = (uint8_t*)dma.getRXTransferPosition() - (registers_ + write_start_);
+            pointer_ = write_start_ + written;
+            if (pointer_ >= registers_size_) {
+                pointer_ = 0;
+            }
+
+            if (written && externalTWISlaveInterruptHandler_) {
+                externalTWISlaveInterruptHandler_->handleTWISlaveWrite(write_start_, written);
+            }
+        }
+    };
+
     // TWIGetHardware is just a pass-through for now
     template <pin_number twiSCKPinNumber, pin_number twiSDAPinNumber>
     using TWIGetHardware = TWIHardware_<TWISCKPin<twiSCKPinNumber>::twiNum>;
 
+    template <pin_number twiSCKPinNumber, pin_number twiSDAPinNumber>
+    using TWISlaveGetHardware = TWISlaveHardware_<TWISCKPin<twiSCKPinNumber>::twiNum>;
+
 } // namespace Motate
 
 #endif /* end of include guard: SAMTWI_H_ONCE */
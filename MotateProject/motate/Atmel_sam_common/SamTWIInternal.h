@@ -42,6 +42,105 @@ struct TWIInfoBase {
     static constexpr bool exists = false;
 };  // TWIInfo <generic>
 
+// TWI clock waveform solver, shared by TWI and TWIHS
+//
+// Both peripherals generate each half of the SCL period as:
+//   t = ((DIV * 2^CKDIV) + offset) * t_peripheral_clock
+// where offset is 3 for TWIHS and 4 for TWI. The high half only starts counting once SCL is
+// seen high, so the rise time of the bus adds to the period as well, and we take it out here.
+//
+// The low half is made at least as long as the spec minimum for the mode (and at least half
+// the period), and the high half gets the rest, rounded up so SCL is never faster than
+// requested, and never less than the spec minimum. CKDIV is kept as small as possible to get
+// the finest steps.
+struct TWIClockSolution {
+    uint32_t cldiv    = 0;
+    uint32_t chdiv    = 0;
+    uint32_t ckdiv    = 0;
+    uint32_t achieved = 0;  // SCL frequency in Hz, or 0 if the requested speed can't be made
+};
+
+static constexpr uint32_t I2C_STANDARD_MODE_SPEED  = 100000;
+static constexpr uint32_t I2C_FAST_MODE_SPEED      = 400000;
+static constexpr uint32_t I2C_FAST_MODE_PLUS_SPEED = 1000000;
+
+constexpr uint32_t twiCeilDiv(uint64_t num, uint64_t den) { return (num + den - 1) / den; }
+
+constexpr TWIClockSolution solveTWIClock(const uint32_t periph_clock,
+                                         const uint32_t speed,
+                                         const uint32_t rise_time_ns,
+                                         const uint32_t offset) {
+    TWIClockSolution solution{};
+    if (speed == 0 || speed > I2C_FAST_MODE_PLUS_SPEED) {
+        return solution;
+    }
+
+    // spec minimums (I2C-bus specification, table 10), in ns
+    uint32_t min_low_ns  = 4700;
+    uint32_t min_high_ns = 4000;
+    if (speed > I2C_FAST_MODE_SPEED) {
+        min_low_ns  = 500;
+        min_high_ns = 260;
+    } else if (speed > I2C_STANDARD_MODE_SPEED) {
+        min_low_ns  = 1300;
+        min_high_ns = 600;
+    }
+
+    const uint32_t rise_clocks     = ((uint64_t)rise_time_ns * periph_clock) / 1000000000ull;
+    const uint32_t period_clocks   = twiCeilDiv(periph_clock, speed); // rounded up, so never too fast
+    const uint32_t min_low_clocks  = twiCeilDiv((uint64_t)min_low_ns * periph_clock, 1000000000ull);
+    const uint32_t min_high_clocks = twiCeilDiv((uint64_t)min_high_ns * periph_clock, 1000000000ull);
+
+    uint32_t available = (period_clocks > rise_clocks) ? (period_clocks - rise_clocks) : 0;
+
+    uint32_t low_clocks = available / 2;
+    if (low_clocks < min_low_clocks) {
+        low_clocks = min_low_clocks;
+    }
+
+    // the offset is the shortest either half can be
+    if (low_clocks < offset) {
+        low_clocks = offset;
+    }
+    const uint32_t shortest_high_clocks = (min_high_clocks > offset) ? min_high_clocks : offset;
+
+    for (uint32_t ckdiv = 0; ckdiv < 8; ckdiv++) {
+        // round the low half up, so it's never shorter than the spec allows
+        const uint32_t cldiv = twiCeilDiv(low_clocks - offset, 1u << ckdiv);
+        if (cldiv > 0xFF) {
+            continue;
+        }
+        const uint32_t actual_low_clocks = (cldiv << ckdiv) + offset;
+
+        // then the high half gets the rest of the period, rounded up, within the spec
+        uint32_t high_left = (available > actual_low_clocks) ? (available - actual_low_clocks) : 0;
+        if (high_left < shortest_high_clocks) {
+            high_left = shortest_high_clocks;
+        }
+        const uint32_t chdiv = twiCeilDiv(high_left - offset, 1u << ckdiv);
+        if (chdiv > 0xFF) {
+            continue;
+        }
+
+        solution.cldiv = cldiv;
+        solution.chdiv = chdiv;
+        solution.ckdiv = ckdiv;
+
+        const uint32_t actual_clocks = actual_low_clocks + ((chdiv << ckdiv) + offset) + rise_clocks;
+        solution.achieved = periph_clock / actual_clocks;
+        break;
+    }
+    return solution;
+}
+
+// SCL must never come out faster than asked for (TWIHS offset 3, TWI offset 4, 300ns rise)
+static_assert(solveTWIClock(150000000, 97000, 300, 3).achieved <= 97000 &&
+                  solveTWIClock(150000000, 97000, 300, 3).achieved > 96000,
+              "97kHz at 150MHz should come out just under 97kHz");
+static_assert(solveTWIClock(150000000, 400000, 300, 3).achieved <= 400000, "400kHz must not be exceeded");
+static_assert(solveTWIClock(84000000, 100000, 300, 4).achieved <= 100000, "100kHz must not be exceeded");
+static_assert(solveTWIClock(84000000, 1000000, 120, 4).achieved <= 1000000, "1MHz must not be exceeded");
+
 #if defined(ID_TWIHS0)
     // This is for the SamS70
 template <>
@@ -134,6 +233,32 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
 
     void transmitChar(uint8_t b) { twi->TWIHS_THR = b; }
 
+    // Slave mode
+    static constexpr bool kSupportsSlave = true;
+
+    void enableSlave(const uint8_t address) {
+        twi->TWIHS_CR  = TWIHS_CR_MSDIS;
+        twi->TWIHS_SMR = TWIHS_SMR_SADR(address);
+        twi->TWIHS_CR  = TWIHS_CR_SVEN;
+    }
+
+    void enableOnSlaveAccessInterrupt() { twi->TWIHS_IER = TWIHS_IER_SVACC; }
+    void disableOnSlaveAccessInterrupt() { twi->TWIHS_IDR = TWIHS_IDR_SVACC; }
+
+    void enableOnEndOfSlaveAccessInterrupt() { twi->TWIHS_IER = TWIHS_IER_EOSACC; }
+    void disableOnEndOfSlaveAccessInterrupt() { twi->TWIHS_IDR = TWIHS_IDR_EOSACC; }
+
+    void enableOnClockWaitInterrupt() { twi->TWIHS_IER = TWIHS_IER_SCL_WS; }
+    void disableOnClockWaitInterrupt() { twi->TWIHS_IDR = TWIHS_IDR_SCL_WS; }
+
+    auto getIMR() { return twi->TWIHS_IMR; }
+    bool isClockWaitEnabled(uint32_t imr = twi->TWIHS_IMR) { return (imr & TWIHS_IMR_SCL_WS); }
+
+    bool isSlaveAccess(uint32_t sr = twi->TWIHS_SR) { return (sr & TWIHS_SR_SVACC); }
+    bool isSlaveRead(uint32_t sr = twi->TWIHS_SR) { return (sr & TWIHS_SR_SVREAD); }
+    bool isEndOfSlaveAccess(uint32_t sr = twi->TWIHS_SR) { return (sr & TWIHS_SR_EOSACC); }
+    bool isClockWait(uint32_t sr = twi->TWIHS_SR) { return (sr & TWIHS_SR_SCLWS); }
+
    protected:
     void _setAddress(uint8_t  adjusted_address,
                      uint32_t adjusted_internal_address,
@@ -142,63 +267,41 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
         twi->TWIHS_IADR = TWIHS_IADR_IADR(adjusted_internal_address);
     }
 
-    /* Low level time limit of I2C Fast Mode. */
-    static constexpr uint32_t LOW_LEVEL_TIME_LIMIT = 384000;
-    static constexpr uint32_t I2C_FAST_MODE_SPEED  = 400000;
-    static constexpr uint32_t TWIHS_CLK_DIVIDER    = 2;
-    static constexpr uint32_t TWIHS_CLK_CALC_ARGU  = 3;
-    static constexpr uint32_t TWIHS_CLK_DIV_MAX    = 0xFF;
-    static constexpr uint32_t TWIHS_CLK_DIV_MIN    = 7;
-
-    void setSpeed(const uint32_t speed = I2C_FAST_MODE_SPEED) {
-        uint32_t ckdiv = 0;
-        uint32_t c_lh_div;
-        uint32_t cldiv, chdiv;
-        auto     periph_clock = SamCommon::getPeripheralClockFreq();
-
-        /* High-Speed can be only used in slave mode, 400k is the max speed allowed for master */
-        if (speed > I2C_FAST_MODE_SPEED) {
-            return;  // FAIL;
+    static constexpr uint32_t TWIHS_CLK_CALC_ARGU = 3;
+    static constexpr uint32_t TWIHS_HOLD_MAX      = 0x1F;
+
+    // Fast mode Plus needs FM+ capable pins and strong enough pull-ups.
+    static constexpr uint32_t kMaxMasterSpeed = I2C_FAST_MODE_PLUS_SPEED;
+
+    // Set SCL to the closest speed not over the requested one, allowing for the bus rise time.
+    // hold_time_ns sets the TWD hold time after TWCK falls (0 leaves the minimum).
+    // Returns the achieved speed in Hz, or 0 (leaving the clock alone) if it can't be done.
+    uint32_t setClock(const uint32_t speed, const uint32_t rise_time_ns = 120, const uint32_t hold_time_ns = 0) {
+        if (speed > kMaxMasterSpeed) {
+            return 0;  // FAIL;
+        }
+
+        auto periph_clock = SamCommon::getPeripheralClockFreq();
+        auto solution     = solveTWIClock(periph_clock, speed, rise_time_ns, TWIHS_CLK_CALC_ARGU);
+        if (solution.achieved == 0) {
+            return 0;  // FAIL;
         }
 
-        /* Low level time not less than 1.3us of I2C Fast Mode. */
-        if (speed > LOW_LEVEL_TIME_LIMIT) {
-            /* Low level of time fixed for 1.3us. */
-            cldiv = periph_clock / (LOW_LEVEL_TIME_LIMIT * TWIHS_CLK_DIVIDER) - TWIHS_CLK_CALC_ARGU;
-            chdiv = periph_clock / ((speed + (speed - LOW_LEVEL_TIME_LIMIT)) * TWIHS_CLK_DIVIDER) - TWIHS_CLK_CALC_ARGU;
-
-            /* cldiv must fit in 8 bits, ckdiv must fit in 3 bits */
-            while ((cldiv > TWIHS_CLK_DIV_MAX) && (ckdiv < TWIHS_CLK_DIV_MIN)) {
-                /* Increase clock divider */
-                ckdiv++;
-                /* Divide cldiv value */
-                cldiv /= TWIHS_CLK_DIVIDER;
-            }
-            /* chdiv must fit in 8 bits, ckdiv must fit in 3 bits */
-            while ((chdiv > TWIHS_CLK_DIV_MAX) && (ckdiv < TWIHS_CLK_DIV_MIN)) {
-                /* Increase clock divider */
-                ckdiv++;
-                /* Divide cldiv value */
-                chdiv /= TWIHS_CLK_DIVIDER;
-            }
-
-            /* set clock waveform generator register */
-            twi->TWIHS_CWGR = TWIHS_CWGR_CLDIV(cldiv) | TWIHS_CWGR_CHDIV(chdiv) | TWIHS_CWGR_CKDIV(ckdiv);
-        } else {
-            c_lh_div = periph_clock / (speed * TWIHS_CLK_DIVIDER) - TWIHS_CLK_CALC_ARGU;
-
-            /* cldiv must fit in 8 bits, ckdiv must fit in 3 bits */
-            while ((c_lh_div > TWIHS_CLK_DIV_MAX) && (ckdiv < TWIHS_CLK_DIV_MIN)) {
-                /* Increase clock divider */
-                ckdiv++;
-                /* Divide cldiv value */
-                c_lh_div /= TWIHS_CLK_DIVIDER;
-            }
-
-            /* set clock waveform generator register */
-            twi->TWIHS_CWGR = TWIHS_CWGR_CLDIV(c_lh_div) | TWIHS_CWGR_CHDIV(c_lh_div) | TWIHS_CWGR_CKDIV(ckdiv);
+        // tHOLD = (HOLD + 3) * t_peripheral_clock
+        uint32_t hold = twiCeilDiv((uint64_t)hold_time_ns * periph_clock, 1000000000ull);
+        hold          = (hold > 3) ? (hold - 3) : 0;
+        if (hold > TWIHS_HOLD_MAX) {
+            hold = TWIHS_HOLD_MAX;
         }
+
+        /* set clock waveform generator register */
+        twi->TWIHS_CWGR = TWIHS_CWGR_CLDIV(solution.cldiv) | TWIHS_CWGR_CHDIV(solution.chdiv) |
+                          TWIHS_CWGR_CKDIV(solution.ckdiv) | TWIHS_CWGR_HOLD(hold);
+
+        return solution.achieved;
     }
+
+    void setSpeed(const uint32_t speed = I2C_FAST_MODE_SPEED) { setClock(speed); }
 };  // TWIInfo <generic>
 #endif
 
@@ -302,7 +405,10 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
 
     void transmitChar(uint8_t b) { twi->TWI_THR = b; }
 
-   private:
+    // Slave mode is only supported on TWIHS for now
+    static constexpr bool kSupportsSlave = false;
+
+   protected:
     void _setAddress(uint8_t  adjusted_address,
                      uint32_t adjusted_internal_address,
                      uint8_t  adjusted_internal_address_size) {
@@ -310,63 +416,32 @@ struct TWIInfo : TWIInfoBase<twiPeripheralNumber> {
         twi->TWI_IADR = TWI_IADR_IADR(adjusted_internal_address);
     }
 
-    /* Low level time limit of I2C Fast Mode. */
-    static constexpr uint32_t LOW_LEVEL_TIME_LIMIT = 384000;
-    static constexpr uint32_t I2C_FAST_MODE_SPEED  = 400000;
-    static constexpr uint32_t TWI_CLK_DIVIDER    = 2;
-    static constexpr uint32_t TWI_CLK_CALC_ARGU  = 3;
-    static constexpr uint32_t TWI_CLK_DIV_MAX    = 0xFF;
-    static constexpr uint32_t TWI_CLK_DIV_MIN    = 7;
-
-    void setSpeed(const uint32_t speed = I2C_FAST_MODE_SPEED) {
-        uint32_t ckdiv = 0;
-        uint32_t c_lh_div;
-        uint32_t cldiv, chdiv;
-        auto     periph_clock = SamCommon::getPeripheralClockFreq();
-
-        /* High-Speed can be only used in slave mode, 400k is the max speed allowed for master */
-        if (speed > I2C_FAST_MODE_SPEED) {
-            return;  // FAIL;
+    static constexpr uint32_t TWI_CLK_CALC_ARGU = 4;
+
+    // The TWI (not TWIHS) peripheral is only rated for Fast mode.
+    static constexpr uint32_t kMaxMasterSpeed = I2C_FAST_MODE_SPEED;
+
+    // Set SCL to the closest speed not over the requested one, allowing for the bus rise time.
+    // This peripheral has no hold time control, so hold_time_ns is ignored.
+    // Returns the achieved speed in Hz, or 0 (leaving the clock alone) if it can't be done.
+    uint32_t setClock(const uint32_t speed, const uint32_t rise_time_ns = 120, const uint32_t hold_time_ns = 0) {
+        if (speed > kMaxMasterSpeed) {
+            return 0;  // FAIL;
         }
 
-        /* Low level time not less than 1.3us of I2C Fast Mode. */
-        if (speed > LOW_LEVEL_TIME_LIMIT) {
-            /* Low level of time fixed for 1.3us. */
-            cldiv = periph_clock / (LOW_LEVEL_TIME_LIMIT * TWI_CLK_DIVIDER) - TWI_CLK_CALC_ARGU;
-            chdiv = periph_clock / ((speed + (speed - LOW_LEVEL_TIME_LIMIT)) * TWI_CLK_DIVIDER) - TWI_CLK_CALC_ARGU;
-
-            /* cldiv must fit in 8 bits, ckdiv must fit in 3 bits */
-            while ((cldiv > TWI_CLK_DIV_MAX) && (ckdiv < TWI_CLK_DIV_MIN)) {
-                /* Increase clock divider */
-                ckdiv++;
-                /* Divide cldiv value */
-                cldiv /= TWI_CLK_DIVIDER;
-            }
-            /* chdiv must fit in 8 bits, ckdiv must fit in 3 bits */
-            while ((chdiv > TWI_CLK_DIV_MAX) && (ckdiv < TWI_CLK_DIV_MIN)) {
-                /* Increase clock divider */
-                ckdiv++;
-                /* Divide cldiv value */
-                chdiv /= TWI_CLK_DIVIDER;
-            }
-
-            /* set clock waveform generator register */
-            twi->TWI_CWGR = TWI_CWGR_CLDIV(cldiv) | TWI_CWGR_CHDIV(chdiv) | TWI_CWGR_CKDIV(ckdiv);
-        } else {
-            c_lh_div = periph_clock / (speed * TWI_CLK_DIVIDER) - TWI_CLK_CALC_ARGU;
-
-            /* cldiv must fit in 8 bits, ckdiv must fit in 3 bits */
-            while ((c_lh_div > TWI_CLK_DIV_MAX) && (ckdiv < TWI_CLK_DIV_MIN)) {
-                /* Increase clock divider */
-                ckdiv++;
-                /* Divide cldiv value */
-                c_lh_div /= TWI_CLK_DIVIDER;
-            }
-
-            /* set clock waveform generator register */
-            twi->TWI_CWGR = TWI_CWGR_CLDIV(c_lh_div) | TWI_CWGR_CHDIV(c_lh_div) | TWI_CWGR_CKDIV(ckdiv);
+        auto periph_clock = SamCommon::getPeripheralClockFreq();
+        auto solution     = solveTWIClock(periph_clock, speed, rise_time_ns, TWI_CLK_CALC_ARGU);
+        if (solution.achieved == 0) {
+            return 0;  // FAIL;
         }
+
+        /* set clock waveform generator register */
+        twi->TWI_CWGR = TWI_CWGR_CLDIV(solution.cldiv) | TWI_CWGR_CHDIV(solution.chdiv) | TWI_CWGR_CKDIV(solution.ckdiv);
+
+        return solution.achieved;
     }
+
+    void setSpeed(const uint32_t speed = I2C_FAST_MODE_SPEED) { setClock(speed); }
 };  // TWIInfo <generic>
 #endif
 
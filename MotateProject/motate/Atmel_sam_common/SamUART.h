@@ -118,6 +118,8 @@ namespace Motate {
 
         std::function<void(Interrupt::Type)> _uartInterruptHandler;
 
+        UART_internal::UARTBaudSolution _baud_solution;
+
         DMA<Usart *, uartPeripheralNumber> dma_ {_uartInterruptHandler};
         constexpr const DMA<Usart *, uartPeripheralNumber> *dma() { return &dma_; };
 
@@ -149,6 +151,9 @@ namespace Motate {
 
             _uartInterruptHandlerJumper = [&]() {
                 auto interruptCause = getInterruptCause();
+                if (_multidrop_address >= 0) {
+                    _handleMultidropAddress();
+                }
                 if (_uartInterruptHandler) {
                     _uartInterruptHandler(interruptCause);
                 }
@@ -165,16 +170,28 @@ namespace Motate {
         void setOptions(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
             disable();
 
-            // Oversampling is either 8 or 16. Depending on the baud, we may need to select 8x in
-            // order to get the error low.
-
-            // For all of the speeds up to and including 230400, 16x multiplier worked fine in testing.
-            // All yielded a <1% error in final baud.
-            usart()->US_BRGR = US_BRGR_CD((((SamCommon::getPeripheralClockFreq() * 10) / (16 * baud)) + 5)/10) | US_BRGR_FP(0);
-            usart()->US_MR &= ~US_MR_OVER;
+            // Oversampling is either 8 or 16, and CD has a fractional part. Depending on the baud, we
+            // may need to select 8x in order to get the error low. See solveUARTBaud().
+            const auto solution = UART_internal::solveUARTBaud(SamCommon::getPeripheralClockFreq(), baud);
+            if (solution.achieved == 0) {
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // baud rate out of range
+#endif
+            } else {
+                _baud_solution = solution;
+                usart()->US_BRGR = US_BRGR_CD(solution.cd) | US_BRGR_FP(solution.fp);
+                if (solution.over8) {
+                    usart()->US_MR |= US_MR_OVER;
+                } else {
+                    usart()->US_MR &= ~US_MR_OVER;
+                }
+            }
 
 
-            if (options & UARTMode::RTSCTSFlowControl) {
+            if (options & UARTMode::RS485) {
+                // RTS is driven high (DE) while sending, and through the timeguard after
+                usart()->US_MR = (usart()->US_MR & ~US_MR_USART_MODE_Msk) | US_MR_USART_MODE_RS485;
+            } else if (options & UARTMode::RTSCTSFlowControl) {
                 usart()->US_MR = (usart()->US_MR & ~US_MR_USART_MODE_Msk) | US_MR_USART_MODE_HW_HANDSHAKING;
             } else {
                 usart()->US_MR = (usart()->US_MR & ~US_MR_USART_MODE_Msk) | US_MR_USART_MODE_NORMAL;
@@ -191,7 +208,9 @@ namespace Motate {
             } else {
                 usart()->US_MR = (usart()->US_MR & ~(US_MR_MODE9|US_MR_CHRL_Msk)) | static_cast<uint32_t>(CHRL_t::CH_8_BIT);
             }
-            if (options & UARTMode::EvenParity) {
+            if (options & UARTMode::Multidrop) {
+                usart()->US_MR = (usart()->US_MR & ~(US_MR_PAR_Msk)) | US_MR_PAR_MULTIDROP;
+            } else if (options & UARTMode::EvenParity) {
                 usart()->US_MR = (usart()->US_MR & ~(US_MR_PAR_Msk)) | US_MR_PAR_EVEN;
             } else if (options & UARTMode::OddParity) {
                 usart()->US_MR = (usart()->US_MR & ~(US_MR_PAR_Msk)) | US_MR_PAR_ODD;
@@ -283,6 +302,10 @@ namespace Motate {
         };
 
         void setInterruptTxTransferDone(bool value) {
+            if (value && (_held_tx_length != 0)) {
+                // nothing is running to be done, resumeTX() turns it on when it starts the held transfer
+                return;
+            }
             if (value) {
                 dma()->startTxDoneInterrupts();
             } else {
@@ -298,6 +321,105 @@ namespace Motate {
             }
         };
 
+        // ***** Multidrop (UARTMode::Multidrop)
+        //
+        // Address characters (sent with the 9th bit set) raise PARE. While a frame is for another
+        // node, the RX DMA is stopped and only PARE interrupts, so the data bytes are dropped by
+        // the hardware without interrupting. When an address character matches, the RX DMA is
+        // started and the frame goes into the RX transfer. The next address character ends it.
+        // While receiving, the DMA takes the address character too, so it's taken back out. This
+        // assumes the interrupt is handled within one character time, so the address is the last
+        // character received: it's still in RHR, and it's either the last one the DMA took or it
+        // hasn't been taken yet. If the DMA had just moved on to a new region, the address is at the
+        // end of the previous one, and is left in the stream.
+
+        int16_t _multidrop_address = -1;   // -1 is off
+        int16_t _multidrop_broadcast = -1; // -1 is none
+        bool _multidrop_receiving = false;
+        char *_rx_region_starts[2] = {nullptr, nullptr}; // of the last two startRXTransfer() calls
+
+        void setMultidropAddress(const int16_t address, const int16_t broadcast_address = -1) {
+            _multidrop_broadcast = broadcast_address;
+            if (address < 0) {
+                usart()->US_IDR = US_IDR_PARE;
+                _multidrop_address = -1;
+                dma()->enableRx();
+                return;
+            }
+
+            dma()->disableRx();
+            _multidrop_receiving = false;
+            _multidrop_address = address;
+            usart()->US_CR = US_CR_RSTSTA;
+            usart()->US_IER = US_IER_PARE;
+        };
+
+        bool _multidropMatches(const uint8_t address) {
+            return (address == _multidrop_address) || (address == _multidrop_broadcast);
+        };
+
+        void _handleMultidropAddress() {
+            if (!(usart()->US_IMR & US_IMR_PARE) || !(usart()->US_CSR & US_CSR_PARE)) {
+                return;
+            }
+            usart()->US_CR = US_CR_RSTSTA;
+
+            if (!_multidrop_receiving) {
+                // the DMA is stopped, so it's still in the holding register
+                const uint8_t address = usart()->US_RHR & US_RHR_RXCHR_Msk;
+                if (_multidropMatches(address)) {
+                    _multidrop_receiving = true;
+                    dma()->enableRx();
+                }
+                return;
+            }
+
+            // stop the DMA so we can see where it got to
+            char *position;
+            do {
+                position = getRXTransferPosition();
+            } while (!dma()->holdRx(position));
+
+            // if RXRDY is set the DMA hasn't taken it, and reading it here keeps it from doing so
+            const bool taken_by_dma = !(usart()->US_CSR & US_CSR_RXRDY);
+            const uint8_t address = usart()->US_RHR & US_RHR_RXCHR_Msk;
+            _multidrop_receiving = _multidropMatches(address);
+
+            // it can only be taken back out if it's in the region the DMA is in now
+            if (taken_by_dma && (position != _rx_region_starts[0]) && (position != _rx_region_starts[1])) {
+                dma()->releaseRx(1, _multidrop_receiving);
+            } else if (_multidrop_receiving) {
+                dma()->enableRx();
+            }
+        };
+
+        // Send address with the 9th bit set, to select the node(s) the following bytes are for.
+        // Call this before starting the TX transfer for the frame.
+        void sendMultidropAddress(const uint8_t address) {
+            while (!(usart()->US_CSR & US_CSR_TXRDY)) { ; }
+            usart()->US_CR = US_CR_SENDA;
+            usart()->US_THR = US_THR_TXCHR(address);
+        };
+
+        // Extra idle time after each character sent, in bit periods. In RS485 mode DE is held
+        // through it, to give the other end time to turn around.
+        void setTurnaroundTime(const uint8_t bit_times) {
+            usart()->US_TTGR = US_TTGR_TG(bit_times);
+        };
+
+        // Use the receiver time-out to raise OnRxIdle once the line has been idle for bit_times
+        // bit periods after a character. It's only raised once per idle period. 0 turns it off.
+        bool setRxIdleTimeout(const uint32_t bit_times) {
+            usart()->US_RTOR = US_RTOR_TO(bit_times);
+            if (bit_times) {
+                usart()->US_CR = US_CR_STTTO; // wait for the next character to start timing
+                usart()->US_IER = US_IER_TIMEOUT;
+            } else {
+                usart()->US_IDR = US_IDR_TIMEOUT;
+            }
+            return true;
+        };
+
         static Interrupt::Type getInterruptCause() { // __attribute__ (( noinline ))
             Interrupt::Type status = UARTInterrupt::Unknown;
 
@@ -331,6 +453,12 @@ namespace Motate {
             {
                 status |= UARTInterrupt::OnCTSChanged;
             }
+            if ((US_IMR_hold & US_IMR_TIMEOUT) && (US_CSR_hold & US_CSR_TIMEOUT))
+            {
+                status |= UARTInterrupt::OnRxIdle;
+                // clear it, and don't start timing again until another character comes in
+                usart()->US_CR = US_CR_STTTO;
+            }
             return status;
         }
 
@@ -362,6 +490,10 @@ namespace Motate {
         };
 
 
+        // The baud rate actually made by the last setOptions(), and how far off it is
+        uint32_t getBaud() const { return _baud_solution.achieved; };
+        int32_t getBaudErrorPPM() const { return _baud_solution.error_ppm; };
+
         // ***** Connection status check (simple)
         bool isConnected() {
             // The cts pin allows to know if we're allowed to send,
@@ -376,20 +508,56 @@ namespace Motate {
         bool startRXTransfer(char *buffer, const uint16_t length) {
             const bool handleInterrupts = true;
             const bool includeNext = true;
-            return dma()->startRXTransfer(buffer, length, handleInterrupts, includeNext);
+            _rx_region_starts[0] = _rx_region_starts[1];
+            _rx_region_starts[1] = buffer;
+            const bool started = dma()->startRXTransfer(buffer, length, handleInterrupts, includeNext);
+            if (_multidrop_address >= 0 && !_multidrop_receiving) {
+                // not our frame, keep it stopped until our address comes in
+                dma()->disableRx();
+            }
+            return started;
         };
 
         char* getRXTransferPosition() {
             return dma()->getRXTransferPosition();
         };
 
+        // Used to strip bytes from the received stream, see DMA holdRx() and releaseRx()
+        bool holdRXTransfer(char *expected_position) { return dma()->holdRx(expected_position); };
+        void releaseRXTransfer(const uint16_t count) { dma()->releaseRx(count, _multidrop_address < 0 || _multidrop_receiving); };
+
         bool _tx_paused = false;
+        // A transfer started while paused is held here, with the DMA off, until resumeTX()
+        char *_held_tx_buffer = nullptr;
+        uint16_t _held_tx_length = 0;
+
         bool startTXTransfer(char *buffer, const uint16_t length) {
+            if (_tx_paused) {
+                if ((length == 0) || (_held_tx_length != 0) || !dma()->doneWriting()) {
+                    return false;
+                }
+                _held_tx_buffer = buffer;
+                _held_tx_length = length;
+                return true;
+            }
             return dma()->startTXTransfer(buffer, length, true);
         };
 
+        // Send value now, ahead of anything the TX DMA has yet to send (for XON/XOFF).
+        void writeControlByte(const char value) {
+            const bool was_sending = !dma()->doneWriting();
+            dma()->disableTx();
+            while (!(usart()->US_CSR & US_CSR_TXRDY)) { ; }
+            usart()->US_THR = US_THR_TXCHR(value);
+            if (was_sending && !_tx_paused) {
+                dma()->enableTx();
+            }
+        };
+
         char* getTXTransferPosition() {
-            if (_tx_paused) { return nullptr; }
+            if (_held_tx_length != 0) {
+                return _held_tx_buffer; // none of it has been sent
+            }
             return dma()->getTXTransferPosition();
         };
 
@@ -400,6 +568,12 @@ namespace Motate {
 
         void resumeTX() {
             _tx_paused = false;
+            if (_held_tx_length != 0) {
+                const uint16_t length = _held_tx_length;
+                _held_tx_length = 0;
+                dma()->startTXTransfer(_held_tx_buffer, length, true);
+                return;
+            }
             dma()->enableTx();
         };
     };
@@ -419,6 +593,8 @@ namespace Motate {
 
         std::function<void(Interrupt::Type)> _uartInterruptHandler;
 
+        UART_internal::UARTBaudSolution _baud_solution;
+
         DMA<Uart *, uartPeripheralNumber> dma_ {_uartInterruptHandler};
         constexpr const DMA<Uart *, uartPeripheralNumber> *dma() { return &dma_; };
 
@@ -464,10 +640,18 @@ namespace Motate {
         void setOptions(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
             disable();
 
-            // Oversampling is either 8 or 16. Depending on the baud, we may need to select 8x in
-            // order to get the error low.
-
-            uart()->UART_BRGR = UART_BRGR_CD(SamCommon::getPeripheralClockFreq() / (16 * baud));
+            // The UART has no oversampling or fractional options, so this is 16x with a whole CD,
+            // rounded to the closest.
+            const auto solution = UART_internal::solveUARTBaud(SamCommon::getPeripheralClockFreq(), baud,
+                                                               /*allow_fractional =*/ false, /*allow_over8 =*/ false);
+            if (solution.achieved == 0) {
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // baud rate out of range
+#endif
+            } else {
+                _baud_solution = solution;
+                uart()->UART_BRGR = UART_BRGR_CD(solution.cd);
+            }
 
             // No hardware flow control
             // if (options & UARTMode::RTSCTSFlowControl) {
@@ -564,6 +748,10 @@ namespace Motate {
         };
 
         void setInterruptTxTransferDone(bool value) {
+            if (value && (_held_tx_length != 0)) {
+                // nothing is running to be done, resumeTX() turns it on when it starts the held transfer
+                return;
+            }
             if (value) {
                 dma()->startTxDoneInterrupts();
             } else {
@@ -579,6 +767,9 @@ namespace Motate {
             }
         };
 
+        // The UART has no receiver time-out
+        bool setRxIdleTimeout(const uint32_t bit_times) { return bit_times == 0; };
+
         Interrupt::Type getInterruptCause() { // __attribute__ (( noinline ))
             Interrupt::Type status = UARTInterrupt::Unknown;
 
@@ -635,6 +826,10 @@ namespace Motate {
         };
 
 
+        // The baud rate actually made by the last setOptions(), and how far off it is
+        uint32_t getBaud() const { return _baud_solution.achieved; };
+        int32_t getBaudErrorPPM() const { return _baud_solution.error_ppm; };
+
         // ***** Connection status check (simple)
         bool isConnected() {
             // The cts pin allows to know if we're allowed to send,
@@ -656,13 +851,42 @@ namespace Motate {
             return dma()->getRXTransferPosition();
         };
 
+        // Used to strip bytes from the received stream, see DMA holdRx() and releaseRx()
+        bool holdRXTransfer(char *expected_position) { return dma()->holdRx(expected_position); };
+        void releaseRXTransfer(const uint16_t count) { dma()->releaseRx(count); };
+
         bool _tx_paused = false;
+        // A transfer started while paused is held here, with the DMA off, until resumeTX()
+        char *_held_tx_buffer = nullptr;
+        uint16_t _held_tx_length = 0;
+
         bool startTXTransfer(char *buffer, const uint16_t length) {
-            if (_tx_paused) { return false; }
+            if (_tx_paused) {
+                if ((length == 0) || (_held_tx_length != 0) || !dma()->doneWriting()) {
+                    return false;
+                }
+                _held_tx_buffer = buffer;
+                _held_tx_length = length;
+                return true;
+            }
             return dma()->startTXTransfer(buffer, length, true);
         };
 
+        // Send value now, ahead of anything the TX DMA has yet to send (for XON/XOFF).
+        void writeControlByte(const char value) {
+            const bool was_sending = !dma()->doneWriting();
+            dma()->disableTx();
+            while (!(uart()->UART_SR & UART_SR_TXRDY)) { ; }
+            uart()->UART_THR = UART_THR_TXCHR(value);
+            if (was_sending && !_tx_paused) {
+                dma()->enableTx();
+            }
+        };
+
         char* getTXTransferPosition() {
+            if (_held_tx_length != 0) {
+                return _held_tx_buffer; // none of it has been sent
+            }
             return dma()->getTXTransferPosition();
         };
 
@@ -673,6 +897,12 @@ namespace Motate {
 
         void resumeTX() {
             _tx_paused = false;
+            if (_held_tx_length != 0) {
+                const uint16_t length = _held_tx_length;
+                _held_tx_length = 0;
+                dma()->startTXTransfer(_held_tx_buffer, length, true);
+                return;
+            }
             dma()->enableTx();
         };
     };
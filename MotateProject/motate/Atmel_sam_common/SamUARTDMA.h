@@ -105,9 +105,9 @@ namespace Motate {
 
             if (interrupts != Interrupt::Off) {
                 if (interrupts & Interrupt::OnTxTransferDone) {
-                    DMA_XDMAC_TX<Uart*, periph_num>::startTxDoneInterrupts();
+                    DMA_XDMAC_TX<Usart*, periph_num>::startTxDoneInterrupts();
                 } else {
-                    DMA_XDMAC_TX<Uart*, periph_num>::stopTxDoneInterrupts();
+                    DMA_XDMAC_TX<Usart*, periph_num>::stopTxDoneInterrupts();
                 }
 
                 if (interrupts & Interrupt::OnRxTransferDone) {
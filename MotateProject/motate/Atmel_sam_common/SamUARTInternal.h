@@ -37,6 +37,98 @@
 
 namespace Motate::UART_internal {
 
+#pragma mark Baud rate solver
+
+// USART baud rate generator solver
+//
+// The USART (with USCLKS = MCK) makes the baud rate as:
+//   baud = MCK / (8 * (2 - OVER) * (CD + FP/8))
+// so in eighths of a CD step, with D = 8*CD + FP:
+//   OVER = 0 (16x): baud = MCK / (2 * D)
+//   OVER = 1 (8x):  baud = MCK / D
+// CD must be 1 to 65535, and FP 0 to 7. The UART (not USART) has no FP or OVER, so
+// allow_fractional is false for those, and only 16x with whole CD values are tried.
+//
+// 16x is preferred since it samples each bit more times, so 8x is only used when 16x can't
+// reach the rate at all, or is off by more than kUARTMaxX16ErrorPPM and 8x is closer.
+struct UARTBaudSolution {
+    uint32_t cd       = 0;
+    uint32_t fp       = 0;
+    bool     over8    = false;
+    uint32_t achieved = 0;  // baud in Hz, or 0 if the requested baud can't be made
+    int32_t  error_ppm = 0; // (achieved - requested) / requested, in parts per million
+};
+
+static constexpr uint32_t kUARTMaxX16ErrorPPM = 1000;
+
+constexpr uint32_t uartRoundDiv(uint64_t num, uint64_t den) { return (num + den / 2) / den; }
+
+constexpr UARTBaudSolution solveUARTBaudCandidate(const uint32_t periph_clock,
+                                                  const uint32_t baud,
+                                                  const bool     over8,
+                                                  const bool     allow_fractional) {
+    UARTBaudSolution solution{};
+    if (baud == 0) {
+        return solution;
+    }
+
+    const uint32_t divisor = over8 ? 1 : 2;            // baud = MCK / (divisor * D)
+    const uint32_t step    = allow_fractional ? 1 : 8; // D steps in eighths, or whole CDs
+    uint64_t eighths = (uint64_t)uartRoundDiv(periph_clock, (uint64_t)divisor * baud * step) * step;
+
+    if (eighths < 8) {
+        // CD can't be 0 (that turns the baud rate generator off)
+        eighths = 8;
+    }
+    if (eighths > ((uint64_t)0xFFFF * 8 + 7)) {
+        return solution;
+    }
+
+    solution.cd       = eighths / 8;
+    solution.fp       = eighths % 8;
+    solution.over8    = over8;
+    solution.achieved = uartRoundDiv(periph_clock, (uint64_t)divisor * eighths);
+    solution.error_ppm = (int32_t)(((int64_t)solution.achieved - baud) * 1000000 / baud);
+    return solution;
+}
+
+constexpr uint32_t uartAbs(int32_t v) { return v < 0 ? -v : v; }
+
+constexpr UARTBaudSolution solveUARTBaud(const uint32_t periph_clock,
+                                         const uint32_t baud,
+                                         const bool     allow_fractional = true,
+                                         const bool     allow_over8 = true) {
+    const UARTBaudSolution x16 = solveUARTBaudCandidate(periph_clock, baud, false, allow_fractional);
+    if (!allow_over8) {
+        return x16;
+    }
+    const UARTBaudSolution x8 = solveUARTBaudCandidate(periph_clock, baud, true, allow_fractional);
+    if (x16.achieved == 0 ||
+        (uartAbs(x16.error_ppm) > kUARTMaxX16ErrorPPM && x8.achieved != 0 && uartAbs(x8.error_ppm) < uartAbs(x16.error_ppm))) {
+        return x8;
+    }
+    return x16;
+}
+
+// Spot checks of the solver against the datasheet formula above
+static_assert(solveUARTBaud(150000000, 115200).cd == 81 && solveUARTBaud(150000000, 115200).fp == 3 &&
+                  !solveUARTBaud(150000000, 115200).over8,
+              "150MHz at 115200 should be 16x with CD=81, FP=3");
+static_assert(solveUARTBaud(150000000, 115200, false, false).cd == 81 &&
+                  solveUARTBaud(150000000, 115200, false, false).fp == 0,
+              "UART (no FP) at 150MHz and 115200 should be CD=81");
+static_assert(solveUARTBaud(84000000, 115200, true, false).cd == 45 && solveUARTBaud(84000000, 115200, true, false).fp == 5,
+              "84MHz at 115200 should be 16x with CD=45, FP=5");
+static_assert(solveUARTBaud(84000000, 115200).over8 && solveUARTBaud(84000000, 115200).cd == 91 &&
+                  solveUARTBaud(84000000, 115200).fp == 1,
+              "84MHz at 115200 is >0.1% off at 16x, so should be 8x with CD=91, FP=1");
+static_assert(solveUARTBaud(150000000, 2000000).over8 && solveUARTBaud(150000000, 2000000).cd == 9 &&
+                  solveUARTBaud(150000000, 2000000).fp == 3 && solveUARTBaud(150000000, 2000000).error_ppm == 0,
+              "150MHz at 2Mbaud should be exact with 8x, CD=9, FP=3");
+static_assert(solveUARTBaud(150000000, 6000000).over8 && solveUARTBaud(150000000, 6000000).cd == 3 &&
+                  solveUARTBaud(150000000, 6000000).fp == 1 && solveUARTBaud(150000000, 6000000).error_ppm == 0,
+              "150MHz at 6Mbaud should be exact with 8x, CD=3, FP=1");
+
 #pragma mark UARTInfo<n> definitions
 
     template<int8_t uartPeripheralNumber>
@@ -305,6 +305,8 @@ namespace Motate {
 
         static constexpr uint32_t _get_endpoint_max_nbr() { return (9); };
         static constexpr uint32_t MAX_PEP_NB() { return (_get_endpoint_max_nbr() + 1); };
+        // Only endpoints 1 through 7 have a DMA channel (USBHS_DEVDMA[ep-1]).
+        static constexpr uint32_t _get_dma_endpoint_max_nbr() { return (7); };
 
         // callback for after a control read is done
         std::function<void(void)> _control_read_completed_callback;
@@ -863,6 +865,55 @@ namespace Motate {
             return (uint8_t *)(USBHS_RAM_ADDR_c + (ep * 0x8000));
         }
 
+        // Copy to and from an endpoint FIFO a word at a time. The FIFO only needs the HSB address to match
+        // the DPRAM pointer modulo 4 (see the warning above), so bytes are copied until the FIFO address is
+        // word aligned, then words, then the remaining bytes. The buffer side may be unaligned, which the
+        // M3/M7 handle for single loads and stores. Both return where the FIFO pointer ended up, so a
+        // packet can be built from more than one buffer.
+
+        static volatile uint8_t *_copyToFifo(volatile uint8_t *fifo, const char *buffer, uint16_t length) {
+            while (length && ((uint32_t)fifo & 0x3)) {
+                *fifo++ = *buffer++;
+                length--;
+            }
+
+            volatile uint32_t *fifo32 = (volatile uint32_t *)fifo;
+            while (length >= 4) {
+                uint32_t word;
+                memcpy(&word, buffer, 4);
+                *fifo32++ = word;
+                buffer += 4;
+                length -= 4;
+            }
+
+            fifo = (volatile uint8_t *)fifo32;
+            while (length--) {
+                *fifo++ = *buffer++;
+            }
+            return fifo;
+        }
+
+        static volatile uint8_t *_copyFromFifo(volatile uint8_t *fifo, char *buffer, uint16_t length) {
+            while (length && ((uint32_t)fifo & 0x3)) {
+                *buffer++ = *fifo++;
+                length--;
+            }
+
+            volatile uint32_t *fifo32 = (volatile uint32_t *)fifo;
+            while (length >= 4) {
+                uint32_t word = *fifo32++;
+                memcpy(buffer, &word, 4);
+                buffer += 4;
+                length -= 4;
+            }
+
+            fifo = (volatile uint8_t *)fifo32;
+            while (length--) {
+                *buffer++ = *fifo++;
+            }
+            return fifo;
+        }
+
         // Intitalization (and attach, detach internal)
 
         void _init() {
@@ -1265,11 +1316,7 @@ namespace Motate {
             if (length < 0)
                 return -1;
 
-            int16_t to_read = length;
-            volatile uint8_t *src = _dev_fifo(0);
-            while (to_read-- > 0) {
-                *buffer++ = *src++;
-            }
+            _copyFromFifo(_dev_fifo(0), buffer, length);
             return length;
         };
 
@@ -1359,10 +1406,11 @@ namespace Motate {
                     _setup_buffer.length_0 = _setup_buffer.length_1; _setup_buffer.length_1 = 0;
                     _setup_buffer.buf_addr_0 = _setup_buffer.buf_addr_1; _setup_buffer.buf_addr_1 = nullptr;
                 }
-                *dst++ = *_setup_buffer.buf_addr_0;
-                _setup_buffer.buf_addr_0++;
-                _setup_buffer.length_0--;
-                to_send--;
+                uint16_t chunk = std::min(to_send, _setup_buffer.length_0);
+                dst = _copyToFifo(dst, _setup_buffer.buf_addr_0, chunk);
+                _setup_buffer.buf_addr_0 += chunk;
+                _setup_buffer.length_0 -= chunk;
+                to_send -= chunk;
             }
 
             _ack_in_send(0);
@@ -1484,15 +1532,18 @@ namespace Motate {
                         {
                             auto byte_count = get_byte_count(ep);
                             auto dma_bytes_left = _devdma_buffer_count(ep);
+                            // In a chained transfer the DMA buffer running out between descriptors isn't the end,
+                            // and the packet keeps filling from the next buffer.
+                            auto dma_done = (0 == dma_bytes_left) && _is_dma_on_last_descriptor(ep);
                             if ((_get_endpoint_size(ep) == byte_count) || // case 3 or 4
-                                (0 == dma_bytes_left)                     // case 2 or 4
+                                dma_done                                  // case 2 or 4
                                 )
                             {
                                 _ack_in_send(ep); // A
                                 _ack_fifocon(ep); // B - This bit is cleared (by writing a one to USBHS_DEVEPTIDRx.FIFOCONC bit) to send the FIFO data and to switch to the next bank.
                             }
 
-                            if (0 == dma_bytes_left) { // case 2 or 4
+                            if (dma_done) { // case 2 or 4
                                 transfer_completed = true; // C+D
                             }
 
@@ -1517,9 +1568,11 @@ namespace Motate {
                                 _ack_out_received(ep); // A
                                 // B - This bit is cleared (by writing a one to USBHS_DEVEPTIDRx.FIFOCONC bit) to free the current bank and to switch to the next bank.
                                 _ack_fifocon(ep);
+                                // The DMA has already moved the packet, so the length isn't known here
+                                proxy->handleDataAvailable(ep, 0);
                             } else {
                                 // case 6
-                                if (0 == _devdma_buffer_count(ep)) {
+                                if ((0 == _devdma_buffer_count(ep)) && _is_dma_on_last_descriptor(ep)) {
                                     transfer_completed = true; // C+D
                                 }
                             }
@@ -1536,12 +1589,26 @@ namespace Motate {
                     uint32_t ep_status = _devdma_status(ep);
 
                     if (ep_status & USBHS_DEVDMASTATUS_DESC_LDST && !transfer_completed) {
-                        if (_is_endpoint_a_tx_in(ep)) {
+                        // bulk transfers run without the endpoint interrupts
+                        if (_is_endpoint_a_tx_in(ep) && _is_endpoint_interrupt_enabled(ep)) {
                             _enable_in_send_interrupt(ep);
                         }
                     }
 
-                    if (ep_status & USBHS_DEVDMASTATUS_END_BF_ST)
+                    if (ep_status & USBHS_DEVDMASTATUS_END_TR_ST)
+                    {
+                        // an RX OUT that was started to end on a short packet got one, maybe in its first buffer
+                        _dma_second_descriptor[ep] = nullptr;
+                        transfer_completed = true;
+                    }
+                    else if ((ep_status & USBHS_DEVDMASTATUS_END_BF_ST) && _dma_second_descriptor[ep])
+                    {
+                        // the first buffer of a two buffer RX OUT filled without a short packet, go on to the second
+                        _devdma(ep)->next_descriptor = _dma_second_descriptor[ep];
+                        _dma_second_descriptor[ep] = nullptr;
+                        _devdma(ep)->command = USB_DMA_Descriptor::load_next_desc;
+                    }
+                    else if ((ep_status & USBHS_DEVDMASTATUS_END_BF_ST) && _is_dma_on_last_descriptor(ep))
                     {
                         // case 2, 4, or 7
 
@@ -1567,7 +1634,35 @@ namespace Motate {
         };
 
         uint32_t _dma_used_by_endpoint;
+        uint32_t _rx_interrupt_endpoints = 0; // bulk OUT endpoints that still report each packet, see enableRXInterrupt()
+
+        // The second buffer of an RX OUT transfer that can end in its first, loaded once the first fills. See transfer().
+        USB_DMA_Descriptor* _dma_second_descriptor[MAX_PEP_NB()] = {};
+
+        // True if the DMA channel of ep is on the last (or only) descriptor of its transfer.
+        bool _is_dma_on_last_descriptor(const uint32_t ep) {
+            return (_devdma(ep)->command != USB_DMA_Descriptor::run_and_link) && (_dma_second_descriptor[ep] == nullptr);
+        };
+
         bool transfer(const uint8_t ep, USB_DMA_Descriptor& desc) {
+            return transfer(ep, desc, nullptr);
+        };
+
+        /* Start a DMA transfer of desc's buffer, then (if desc2 isn't null) continue with desc2's buffer,
+         * as one transfer with one call to handleTransferDone(). Each buffer may be up to 65535 bytes.
+         *
+         * Bulk endpoints run the whole transfer in hardware: the banks are switched automatically
+         * (AUTOSW), a short last IN packet is validated at the end of the buffer (END_B_EN), and the only
+         * interrupt is from the DMA when the transfer is done. Other endpoint types, and bulk OUT
+         * endpoints with enableRXInterrupt(), are still walked along packet-by-packet by
+         * checkAndHandleEndpoint().
+         *
+         * The caller's end_transfer_enable is kept on both descriptors. For an OUT transfer with it set on
+         * desc, a short packet ends the whole transfer in the first buffer. The DMA would load the next
+         * descriptor after that and carry on into the second buffer with the host's next transfer, so in
+         * that case desc2 isn't linked, and checkAndHandleEndpoint() loads it when the first buffer fills.
+         */
+        bool transfer(const uint8_t ep, USB_DMA_Descriptor& desc, USB_DMA_Descriptor* desc2) {
             if (!config_number) {
 #if IN_DEBUGGER == 1
                 __asm__("BKPT"); // endpoint not configured
@@ -1575,18 +1670,53 @@ namespace Motate {
                 return false;
             }
 
-            desc.command = USB_DMA_Descriptor::run_and_stop;
+            const bool is_in = _is_endpoint_a_tx_in(ep);
+            const bool is_bulk = (_get_endpoint_type(ep) == kEndpointBufferTypeBulk);
+
+            if (desc2 && (desc2->buffer_length == 0)) {
+                desc2 = nullptr;
+            }
+
+            USB_DMA_Descriptor& last = desc2 ? *desc2 : desc;
+
+            last.command = USB_DMA_Descriptor::run_and_stop;
+            last.next_descriptor = nullptr;
             // DON'T interrupt when the descriptor is loaded
-            desc.descriptor_loaded_interrupt_enable = false;
-            if (_is_endpoint_a_tx_in(ep)) {
+            last.descriptor_loaded_interrupt_enable = false;
+            if (is_in) {
                 // if the endpoint is a TX IN:
                 // validate the packet at DMA Buffer End (BUFF_COUNT reaches 0)
-                desc.end_buffer_enable = true;
+                last.end_buffer_enable = true;
+            }
+            // interrupt when the DMA transfer ends because the buffer ran out
+            last.end_buffer_interrupt_enable = true;
+
+            _dma_second_descriptor[ep] = nullptr;
+            if (desc2 && !is_in && desc.end_transfer_enable) {
+                // The first buffer stops on its own, and interrupts either to end the transfer or to load desc2
+                desc.command = USB_DMA_Descriptor::run_and_stop;
+                desc.next_descriptor = nullptr;
+                desc.end_transfer_interrupt_enable = true;
+                desc.end_buffer_interrupt_enable = true;
+                desc.descriptor_loaded_interrupt_enable = false;
+                _dma_second_descriptor[ep] = desc2;
+            } else if (desc2) {
+                // The first buffer flows right into the second, with no interrupts
+                desc.command = USB_DMA_Descriptor::run_and_link;
+                desc.next_descriptor = desc2;
+                if (is_in) {
+                    // and no short packet validated between them
+                    desc.end_buffer_enable = false;
+                }
+                desc.end_transfer_interrupt_enable = false;
+                desc.end_buffer_interrupt_enable = false;
+                desc.descriptor_loaded_interrupt_enable = false;
+            }
+
+            if (is_in && !is_bulk) {
                 // we use the descriptor loaded to turn on the other iterrupts
                 desc.descriptor_loaded_interrupt_enable = true;
             }
-            // interrupt when the DMA transfer ends because the buffer ran out
-            desc.end_buffer_interrupt_enable = true;
 
             _dma_used_by_endpoint |= 1 << ep;
 
@@ -1594,14 +1724,19 @@ namespace Motate {
             _devdma(ep)->next_descriptor = &desc;
             _devdma(ep)->command = USB_DMA_Descriptor::load_next_desc;
 
-            if (_is_endpoint_a_tx_in(ep)) {
-                _enable_in_send_interrupt(ep);
+            if (is_in) {
                 _enable_short_packet_interrupt(ep); // this allows the DMA to send a partial packet (badly named function)
-            } else {
-                _enable_out_received_interrupt(ep);
             }
 
-            _enable_endpoint_interrupt(ep);
+            if (!is_bulk || (!is_in && (_rx_interrupt_endpoints & (1 << ep)))) {
+                if (is_in) {
+                    _enable_in_send_interrupt(ep);
+                } else {
+                    _enable_out_received_interrupt(ep);
+                }
+
+                _enable_endpoint_interrupt(ep);
+            }
             _enable_endpoint_dma_interrupt(ep);
 
             return true;
@@ -1619,11 +1754,18 @@ namespace Motate {
 //            _flushReadEndpoint(endpoint);
         }
 
+        // Call proxy->handleDataAvailable() as each packet arrives on an OUT endpoint. Bulk transfers
+        // otherwise only interrupt when they're done, so this puts them back on the per-packet path.
         void enableRXInterrupt(const uint8_t endpoint) {
+            _rx_interrupt_endpoints |= 1 << endpoint;
             _enable_out_received_interrupt(endpoint);
+            if (_dma_used_by_endpoint & (1 << endpoint)) {
+                _enable_endpoint_interrupt(endpoint);
+            }
         };
 
         void disableRXInterrupt(const uint8_t endpoint) {
+            _rx_interrupt_endpoints &= ~(1 << endpoint);
             _disable_out_received_interrupt(endpoint);
         };
 
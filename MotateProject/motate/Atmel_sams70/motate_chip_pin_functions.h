@@ -173,6 +173,20 @@ namespace Motate {
     _MAKE_MOTATE_SPI_SCK_PIN ('D', 22, /* SPINum:*/ 0, /* Peripheral */ B);
 #endif // PIOD
 
+    // USARTs in SPI master mode
+    // NOTE: SPIs 4 and up (here) are USART0 and up, and the RTS pin is the (only) CS
+#ifdef PIOB
+    _MAKE_MOTATE_SPI_CS_PIN  ('B',  3, /* SPINum:*/ 4+0, /* Peripheral:*/ C, /* CS Index:*/ 0);
+    _MAKE_MOTATE_SPI_MISO_PIN('B',  0, /* SPINum:*/ 4+0, /* Peripheral */ C);
+    _MAKE_MOTATE_SPI_MOSI_PIN('B',  1, /* SPINum:*/ 4+0, /* Peripheral */ C);
+    _MAKE_MOTATE_SPI_SCK_PIN ('B', 13, /* SPINum:*/ 4+0, /* Peripheral */ C);
+
+    _MAKE_MOTATE_SPI_CS_PIN  ('A', 24, /* SPINum:*/ 4+1, /* Peripheral:*/ A, /* CS Index:*/ 0);
+    _MAKE_MOTATE_SPI_MISO_PIN('A', 21, /* SPINum:*/ 4+1, /* Peripheral */ A);
+    _MAKE_MOTATE_SPI_MOSI_PIN('B',  4, /* SPINum:*/ 4+1, /* Peripheral */ D);
+    _MAKE_MOTATE_SPI_SCK_PIN ('A', 23, /* SPINum:*/ 4+1, /* Peripheral */ A);
+#endif // PIOB
+
     //
     // UART Pin Assignments
     // NOTE: UARTs 4,5,6 and 7 (here) are UART0 thru UART4 hardware
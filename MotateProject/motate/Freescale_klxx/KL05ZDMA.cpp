@@ -0,0 +1,63 @@
+/*
+ KL05ZDMA.cpp - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#if defined(__KL05Z__)
+
+#include "Freescale_klxx/KL05ZDMA.h"
+
+namespace Motate {
+    _KLDMAInterrupt *_first_kl_dma_interrupt = nullptr;
+
+    // Each channel has its own IRQ, so find the owner of that channel
+    void _handleKLDMAInterrupt(const uint8_t channel) {
+        _KLDMAInterrupt *current = _first_kl_dma_interrupt;
+        while (current != nullptr) {
+            if (current->channel_num == channel) {
+                current->interrupt_handler();
+                return;
+            }
+            current = current->next;
+        }
+
+        // Nobody owns it, so clear it so we don't keep coming back here
+        DMA0->DMA[channel].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+    }
+}
+
+extern "C" {
+
+    void DMA0_IRQHandler(void) { Motate::_handleKLDMAInterrupt(0); }
+    void DMA1_IRQHandler(void) { Motate::_handleKLDMAInterrupt(1); }
+    void DMA2_IRQHandler(void) { Motate::_handleKLDMAInterrupt(2); }
+    void DMA3_IRQHandler(void) { Motate::_handleKLDMAInterrupt(3); }
+
+}
+
+#endif // __KL05Z__
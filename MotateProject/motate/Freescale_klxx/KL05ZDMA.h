@@ -0,0 +1,591 @@
+/*
+ KL05ZDMA.h - Library for the Motate system
+ http://github.com/synthetos/motate/
+
+ Copyright (c) 2018 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef KL05ZDMA_H_ONCE
+#define KL05ZDMA_H_ONCE
+
+#include "MKL05Z4.h" // Redundant, but best to be explicit
+#include "MotateCommon.h"
+
+#include <functional>  // for std::function
+#include <type_traits> // for std::alignment_of and std::remove_pointer
+
+namespace Motate {
+
+    // DMA template - MUST be specialized
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA {
+        DMA() = delete; // this prevents accidental direct instantiation
+        template<typename... T>
+        DMA(T...) {}; // this prevents accidental direct instantiation
+        static constexpr bool exists = false;
+    };
+
+    // The KL05Z has one DMA controller with four channels, and a DMAMUX that routes one peripheral
+    // request to each channel. This is the same shape as the SAM XDMAC: each peripheral owns a DMA<>
+    // made of a TX and/or an RX half, and each half owns a channel.
+    //
+    // Since there are only four channels, a half doesn't take a channel until it's reset (which the
+    // peripherals do the first time they start a transfer), so owners that never use DMA don't use
+    // one up.
+
+    // DMA_KL_TX_hardware and DMA_KL_RX_hardware templates - MUST be specialized by the peripherals
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_KL_TX_hardware {
+        DMA_KL_TX_hardware() = delete;
+    };
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_KL_RX_hardware {
+        DMA_KL_RX_hardware() = delete;
+    };
+
+    typedef typename std::remove_extent<decltype(DMA_Type::DMA)>::type DMAChannel_Type;
+
+    static constexpr uint8_t kKLDMAChannelCount = 4;
+    static constexpr uint8_t kKLDMANoChannel    = 0xFF;
+
+    struct DMA_KL_common {
+        static DMA_Type * const dma() { return DMA0; };
+        static DMAMUX_Type * const dmamux() { return DMAMUX0; };
+        static constexpr IRQn_Type dmaIRQ(const uint8_t channel) { return (IRQn_Type)(DMA0_IRQn + channel); };
+
+        static void enablePeripheralClocks() {
+            SIM->SCGC6 |= SIM_SCGC6_DMAMUX_MASK;
+            SIM->SCGC7 |= SIM_SCGC7_DMA_MASK;
+        };
+
+        // Transfer sizes, as used in DCR SSIZE and DSIZE
+        static constexpr uint32_t transferSize(const uint8_t byte_width) {
+            return (byte_width == 1) ? 1 : ((byte_width == 2) ? 2 : 0);
+        };
+
+        static void setInterruptPriority(const uint8_t channel, const Interrupt::Type interrupts)
+        {
+            if (channel == kKLDMANoChannel) {
+                return;
+            }
+
+            // Once it's known that interrupts are required, always have them on
+            NVIC_EnableIRQ(dmaIRQ(channel));
+
+            /* Set interrupt priority -- the M0+ only has four levels */
+            if (interrupts & Interrupt::PriorityHighest) {
+                NVIC_SetPriority(dmaIRQ(channel), 0);
+            }
+            else if (interrupts & (Interrupt::PriorityHigh | Interrupt::PriorityMedium)) {
+                NVIC_SetPriority(dmaIRQ(channel), 1);
+            }
+            else if (interrupts & Interrupt::PriorityLow) {
+                NVIC_SetPriority(dmaIRQ(channel), 2);
+            }
+            else if (interrupts & Interrupt::PriorityLowest) {
+                NVIC_SetPriority(dmaIRQ(channel), 3);
+            }
+        };
+    };
+
+    struct _KLDMAInterrupt {
+        const std::function<void(void)> interrupt_handler;
+        uint8_t                         channel_num = kKLDMANoChannel;
+        _KLDMAInterrupt*                next;
+
+        _KLDMAInterrupt(const _KLDMAInterrupt&) = delete;             // delete the copy constructor, we only allow moves
+        _KLDMAInterrupt &operator=(const _KLDMAInterrupt &) = delete; // delete the assigment operator, we only allow moves
+
+        // Note we MOVE construct this interrupt function...
+        _KLDMAInterrupt(const std::function<void(void)>&& _interrupt,
+                        _KLDMAInterrupt*&                 _first)
+            : interrupt_handler{std::move(_interrupt)}, next{nullptr} {
+            if (_first == nullptr) {
+                _first = this;
+                return;
+            }
+
+            _KLDMAInterrupt* i = _first;
+            while (i->next != nullptr) {
+                i = i->next;
+            }
+            i->next = this;
+        };
+
+        // Take the lowest free channel, if we don't have one already.
+        // Returns false if all of the channels are taken.
+        bool claim(_KLDMAInterrupt* first) {
+            if (channel_num != kKLDMANoChannel) {
+                return true;
+            }
+
+            uint8_t used = 0;
+            for (_KLDMAInterrupt* i = first; i != nullptr; i = i->next) {
+                if (i->channel_num != kKLDMANoChannel) {
+                    used |= 1 << i->channel_num;
+                }
+            }
+            for (uint8_t channel = 0; channel < kKLDMAChannelCount; channel++) {
+                if (!(used & (1 << channel))) {
+                    channel_num = channel;
+                    return true;
+                }
+            }
+
+#if IN_DEBUGGER == 1
+            __asm__("BKPT"); // out of DMA channels
+#endif
+            return false;
+        };
+
+        uint8_t getChannel() const { return channel_num; }
+    };
+
+    extern _KLDMAInterrupt *_first_kl_dma_interrupt;
+
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_KL_TX : virtual DMA_KL_TX_hardware<periph_t, periph_num>, virtual DMA_KL_common {
+        typedef DMA_KL_TX_hardware<periph_t, periph_num> _hw;
+
+        using _hw::dmaTxRequestSource;
+        using _hw::dmaPeripheralTxAddress;
+
+        typedef typename _hw::buffer_t buffer_t;
+
+        const std::function<void(Interrupt::Type)> &_dmaInterruptHandler;
+
+        _KLDMAInterrupt _tx_interrupt{
+            [&]() {
+                const uint32_t dsr_hold = dmaTxChannel()->DSR_BCR;
+                Interrupt::Type cause = Interrupt::Unknown;
+                if (dsr_hold & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK | DMA_DSR_BCR_BED_MASK)) {
+                    cause |= Interrupt::OnTxError;
+                } else if (dsr_hold & DMA_DSR_BCR_DONE_MASK) {
+                    cause |= Interrupt::OnTxTransferDone;
+                }
+                // writing DONE clears DONE and the error flags, and the interrupt
+                dmaTxChannel()->DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+
+                if (_dmaInterruptHandler) {
+                    _dmaInterruptHandler(cause);
+                }
+            },
+            _first_kl_dma_interrupt};
+
+        const uint8_t dmaTxChannelNumber() const { return _tx_interrupt.getChannel(); }
+        volatile DMAChannel_Type * const dmaTxChannel() const
+        {
+            return dma()->DMA + dmaTxChannelNumber();
+        };
+        bool hasTxChannel() const { return dmaTxChannelNumber() != kKLDMANoChannel; };
+
+        // we'll hold a reference to the handler, the peripheral owns the one it's passing
+        constexpr DMA_KL_TX(const std::function<void(Interrupt::Type)> &handler) : _dmaInterruptHandler{handler} {};
+
+        bool resetTX()
+        {
+            if (!_tx_interrupt.claim(_first_kl_dma_interrupt)) {
+                return false;
+            }
+
+            enablePeripheralClocks();
+
+            // Configure the Tx
+            // ASSUMPTIONS:
+            //  * Tx is memory to peripheral, one unit per peripheral request
+            //  * The request is dropped when the count reaches zero (D_REQ), so a transfer stops on its own
+            //
+            // If ANY of those assumptions are wrong, this code must change!!
+
+            dmamux()->CHCFG[dmaTxChannelNumber()] = 0;
+            disableTx();
+            dmaTxChannel()->DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+            dmaTxChannel()->DAR = (uint32_t)dmaPeripheralTxAddress();
+            dmaTxChannel()->DCR =
+                DMA_DCR_CS_MASK |                       // cycle-steal: one unit for each request
+                DMA_DCR_SINC_MASK |                     // the source address increments as written
+                DMA_DCR_SSIZE(transferSize(1)) |
+                DMA_DCR_DSIZE(transferSize(1)) |        // destination address doesn't change (data register)
+                DMA_DCR_D_REQ_MASK                      // clear ERQ when BCR reaches 0
+                ;
+            dmamux()->CHCFG[dmaTxChannelNumber()] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(dmaTxRequestSource());
+
+            // the done interrupts are still masked per-transfer, setInterrupts() can raise the priority
+            setInterruptPriority(dmaTxChannelNumber(), Interrupt::PriorityLowest);
+            return true;
+        };
+
+        void disableTx() const
+        {
+            if (!hasTxChannel()) { return; }
+            dmaTxChannel()->DCR &= ~DMA_DCR_ERQ_MASK;
+        };
+        void enableTx() const
+        {
+            dmaTxChannel()->DCR |= DMA_DCR_ERQ_MASK;
+        };
+
+        alignas(4) uint8_t dummy_buffer[4] = {0xbe, 0xef, 0xed, 0xff};
+        void setTx(void * const buffer, const uint32_t length, const uint8_t byte_width = 1) const
+        {
+            dmaTxChannel()->DSR_BCR = DMA_DSR_BCR_DONE_MASK; // clear the status before loading
+            dmaTxChannel()->DCR =
+                (dmaTxChannel()->DCR & ~(DMA_DCR_SINC_MASK | DMA_DCR_SSIZE_MASK | DMA_DCR_DSIZE_MASK)) |
+                (buffer != nullptr ? DMA_DCR_SINC_MASK : 0) |
+                DMA_DCR_SSIZE(transferSize(byte_width)) |
+                DMA_DCR_DSIZE(transferSize(byte_width))
+                ;
+            dmaTxChannel()->SAR = (uint32_t)(buffer != nullptr ? buffer : dummy_buffer);
+            dmaTxChannel()->DSR_BCR = DMA_DSR_BCR_BCR(length * byte_width); // BCR is in bytes
+        };
+        uint32_t leftToWrite(bool include_next = false) const
+        {
+            if (!hasTxChannel()) { return 0; }
+            const uint32_t bytes = dmaTxChannel()->DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+            const bool halfwords = (dmaTxChannel()->DCR & DMA_DCR_SSIZE_MASK) == DMA_DCR_SSIZE(transferSize(2));
+            return halfwords ? (bytes >> 1) : bytes;
+        };
+        bool doneWriting(bool include_next = false) const
+        {
+            return leftToWrite(include_next) == 0;
+        };
+        buffer_t getTXTransferPosition() const
+        {
+            if (!hasTxChannel()) { return nullptr; }
+            return (buffer_t)dmaTxChannel()->SAR;
+        };
+
+        // Bundle it all up
+        bool startTXTransfer(void* const    buffer,
+                             const uint32_t length,
+                             const bool     handle_interrupts = true,
+                             const bool     include_next      = false,
+                             const uint8_t  byte_width        = 1
+                            )
+        {
+            if (!hasTxChannel() && !resetTX()) {
+                return false;
+            }
+            if (doneWriting()) {
+                disableTx();
+                if (handle_interrupts) { stopTxDoneInterrupts(); }
+                setTx(buffer, length, byte_width);
+                if (length != 0) {
+                    if (handle_interrupts) { startTxDoneInterrupts(); }
+                    enableTx();
+                    return true;
+                }
+                return false;
+            }
+            return false;
+        };
+
+        void startTxDoneInterrupts() const { if (hasTxChannel()) { dmaTxChannel()->DCR |= DMA_DCR_EINT_MASK; } };
+        void stopTxDoneInterrupts() const { if (hasTxChannel()) { dmaTxChannel()->DCR &= ~DMA_DCR_EINT_MASK; } };
+
+        void setTxInterruptPriority(const Interrupt::Type interrupts) const {
+            setInterruptPriority(dmaTxChannelNumber(), interrupts);
+        };
+
+        // This gets called from the peripheral interrupt handler, and must always return false
+        constexpr bool inTxBufferEmptyInterrupt() const { return false; };
+    };
+
+    // DMA_KL is split into two halves, TX and RX. Each or both can be inherited from.
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_KL_RX : virtual DMA_KL_RX_hardware<periph_t, periph_num>, virtual DMA_KL_common {
+        typedef DMA_KL_RX_hardware<periph_t, periph_num> _hw;
+
+        using _hw::dmaRxRequestSource;
+        using _hw::dmaPeripheralRxAddress;
+
+        typedef typename _hw::buffer_t buffer_t;
+
+        const std::function<void(Interrupt::Type)> &_dmaInterruptHandler;
+
+        _KLDMAInterrupt _rx_interrupt{
+            [&]() {
+                const uint32_t dsr_hold = dmaRxChannel()->DSR_BCR;
+                Interrupt::Type cause = Interrupt::Unknown;
+                if (dsr_hold & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK | DMA_DSR_BCR_BED_MASK)) {
+                    cause |= Interrupt::OnRxError;
+                } else if (dsr_hold & DMA_DSR_BCR_DONE_MASK) {
+                    cause |= Interrupt::OnRxTransferDone;
+                }
+                // writing DONE clears DONE and the error flags, and the interrupt
+                dmaRxChannel()->DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+
+                if (_dmaInterruptHandler) {
+                    _dmaInterruptHandler(cause);
+                }
+            },
+            _first_kl_dma_interrupt};
+
+        const uint8_t dmaRxChannelNumber() const { return _rx_interrupt.getChannel(); }
+        volatile DMAChannel_Type * const dmaRxChannel() const
+        {
+            return dma()->DMA + dmaRxChannelNumber();
+        };
+        bool hasRxChannel() const { return dmaRxChannelNumber() != kKLDMANoChannel; };
+
+        constexpr DMA_KL_RX(const std::function<void(Interrupt::Type)> &handler) : _dmaInterruptHandler{handler} {};
+
+        bool resetRX()
+        {
+            if (!_rx_interrupt.claim(_first_kl_dma_interrupt)) {
+                return false;
+            }
+
+            enablePeripheralClocks();
+
+            // Configure the Rx
+            // ASSUMPTIONS:
+            //  * Rx is from peripheral to memory, one unit per peripheral request
+            //  * The request is dropped when the count reaches zero (D_REQ), so a transfer stops on its own
+            //
+            // If ANY of those assumptions are wrong, this code must change!!
+
+            dmamux()->CHCFG[dmaRxChannelNumber()] = 0;
+            disableRx();
+            dmaRxChannel()->DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+            dmaRxChannel()->SAR = (uint32_t)dmaPeripheralRxAddress();
+            dmaRxChannel()->DCR =
+                DMA_DCR_CS_MASK |                       // cycle-steal: one unit for each request
+                DMA_DCR_SSIZE(transferSize(1)) |        // the source address doesn't change (data register)
+                DMA_DCR_DINC_MASK |                     // destination address increments as read
+                DMA_DCR_DSIZE(transferSize(1)) |
+                DMA_DCR_D_REQ_MASK                      // clear ERQ when BCR reaches 0
+                ;
+            dmamux()->CHCFG[dmaRxChannelNumber()] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(dmaRxRequestSource());
+
+            // the done interrupts are still masked per-transfer, setInterrupts() can raise the priority
+            setInterruptPriority(dmaRxChannelNumber(), Interrupt::PriorityLowest);
+            return true;
+        };
+
+        void disableRx() const
+        {
+            if (!hasRxChannel()) { return; }
+            dmaRxChannel()->DCR &= ~DMA_DCR_ERQ_MASK;
+        };
+        void enableRx() const
+        {
+            dmaRxChannel()->DCR |= DMA_DCR_ERQ_MASK;
+        };
+
+        alignas(4) uint8_t dummy_buffer[4] = {0xbe, 0xef, 0xed, 0xff};
+        void setRx(void* const buffer, const uint32_t length, const uint8_t byte_width = 1) const {
+            dmaRxChannel()->DSR_BCR = DMA_DSR_BCR_DONE_MASK; // clear the status before loading
+            dmaRxChannel()->DCR =
+                (dmaRxChannel()->DCR & ~(DMA_DCR_DINC_MASK | DMA_DCR_SSIZE_MASK | DMA_DCR_DSIZE_MASK)) |
+                (buffer != nullptr ? DMA_DCR_DINC_MASK : 0) |
+                DMA_DCR_SSIZE(transferSize(byte_width)) |
+                DMA_DCR_DSIZE(transferSize(byte_width))
+                ;
+            dmaRxChannel()->DAR = (uint32_t)(buffer != nullptr ? buffer : dummy_buffer);
+            dmaRxChannel()->DSR_BCR = DMA_DSR_BCR_BCR(length * byte_width); // BCR is in bytes
+        };
+        uint32_t leftToRead(bool include_next = false) const
+        {
+            if (!hasRxChannel()) { return 0; }
+            const uint32_t bytes = dmaRxChannel()->DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+            const bool halfwords = (dmaRxChannel()->DCR & DMA_DCR_DSIZE_MASK) == DMA_DCR_DSIZE(transferSize(2));
+            return halfwords ? (bytes >> 1) : bytes;
+        };
+        bool doneReading(bool include_next = false) const
+        {
+            return leftToRead(include_next) == 0;
+        };
+        buffer_t getRXTransferPosition() const
+        {
+            if (!hasRxChannel()) { return nullptr; }
+            return (buffer_t)dmaRxChannel()->DAR;
+        };
+
+        // Bundle it all up
+        bool startRXTransfer(void * const buffer,
+                             const uint32_t length,
+                             const bool handle_interrupts = true,
+                             const bool include_next = false,
+                             const uint8_t byte_width = 1
+                             )
+        {
+            if (0 == length) { return false; }
+            if (!hasRxChannel() && !resetRX()) {
+                return false;
+            }
+
+            disableRx();
+            if (handle_interrupts) {
+                stopRxDoneInterrupts();
+            }
+            setRx(buffer, length, byte_width);
+            if (handle_interrupts) {
+                startRxDoneInterrupts();
+            }
+            enableRx();
+
+            return true;
+        };
+
+        void startRxDoneInterrupts() const { if (hasRxChannel()) { dmaRxChannel()->DCR |= DMA_DCR_EINT_MASK; } };
+        void stopRxDoneInterrupts() const { if (hasRxChannel()) { dmaRxChannel()->DCR &= ~DMA_DCR_EINT_MASK; } };
+
+        void setRxInterruptPriority(const Interrupt::Type interrupts) const {
+            setInterruptPriority(dmaRxChannelNumber(), interrupts);
+        };
+
+        // This gets called from the peripheral interrupt handler, and must always return false
+        constexpr bool inRxBufferFullInterrupt() const { return false; };
+    };
+
+    // Construct a DMA for a peripheral that has both halves
+    template<typename periph_t, uint8_t periph_num>
+    struct DMA_KL : DMA_KL_RX<periph_t, periph_num>, DMA_KL_TX<periph_t, periph_num> {
+        typedef DMA_KL_RX<periph_t, periph_num> _rx;
+        typedef DMA_KL_TX<periph_t, periph_num> _tx;
+
+        constexpr DMA_KL(const std::function<void(Interrupt::Type)> &handler) : _rx{handler}, _tx{handler} {};
+
+        void setInterrupts(const Interrupt::Type interrupts)
+        {
+            if (interrupts != Interrupt::Off) {
+                if (interrupts & Interrupt::OnTxTransferDone) {
+                    _tx::setTxInterruptPriority(interrupts);
+                    _tx::startTxDoneInterrupts();
+                } else {
+                    _tx::stopTxDoneInterrupts();
+                }
+
+                if (interrupts & Interrupt::OnRxTransferDone) {
+                    _rx::setRxInterruptPriority(interrupts);
+                    _rx::startRxDoneInterrupts();
+                } else {
+                    _rx::stopRxDoneInterrupts();
+                }
+            } else {
+                _tx::stopTxDoneInterrupts();
+                _rx::stopRxDoneInterrupts();
+            }
+        };
+
+        bool reset() {
+            return _tx::resetTX() && _rx::resetRX();
+        };
+    };
+
+
+#pragma mark DMA_KL UART0 implementation
+
+    template<uint8_t uartPeripheralNumber>
+    struct DMA_KL_TX_hardware<UART0_Type*, uartPeripheralNumber> {
+        typedef char* buffer_t;
+
+        static constexpr uint8_t dmaTxRequestSource() { return 3; };
+        static volatile void * const dmaPeripheralTxAddress() { return &UART0->D; };
+    };
+
+    template<uint8_t uartPeripheralNumber>
+    struct DMA_KL_RX_hardware<UART0_Type*, uartPeripheralNumber> {
+        typedef char* buffer_t;
+
+        static constexpr uint8_t dmaRxRequestSource() { return 2; };
+        static volatile void * const dmaPeripheralRxAddress() { return &UART0->D; };
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<UART0_Type*, periph_num> : DMA_KL<UART0_Type*, periph_num> {
+        // nothing to do here, except for a constxpr constructor
+        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_KL<UART0_Type*, periph_num>{handler} {};
+    };
+
+
+#pragma mark DMA_KL SPI0 implementation
+
+    template<uint8_t spiPeripheralNumber>
+    struct DMA_KL_TX_hardware<SPI_Type*, spiPeripheralNumber> {
+        typedef uint8_t* buffer_t;
+
+        static constexpr uint8_t dmaTxRequestSource() { return 17; };
+        static volatile void * const dmaPeripheralTxAddress() { return &SPI0->D; };
+    };
+
+    template<uint8_t spiPeripheralNumber>
+    struct DMA_KL_RX_hardware<SPI_Type*, spiPeripheralNumber> {
+        typedef uint8_t* buffer_t;
+
+        static constexpr uint8_t dmaRxRequestSource() { return 16; };
+        static volatile void * const dmaPeripheralRxAddress() { return &SPI0->D; };
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<SPI_Type*, periph_num> : DMA_KL<SPI_Type*, periph_num> {
+        // nothing to do here, except for a constxpr constructor
+        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : DMA_KL<SPI_Type*, periph_num>{handler} {};
+    };
+
+
+#pragma mark DMA_KL TPM implementation
+
+    // periph_num is (timerNum << 4) | channelNum. The transfer is paced by the timer overflow, and
+    // writes one value to the channel's CnV each period.
+    template<uint8_t timerChannelNum>
+    struct DMA_KL_TX_hardware<TPM_Type*, timerChannelNum> {
+        typedef uint16_t* buffer_t;
+
+        static constexpr uint8_t timerNum() { return timerChannelNum >> 4; };
+        static constexpr uint8_t channelNum() { return timerChannelNum & 0x0F; };
+
+        static constexpr uint8_t dmaTxRequestSource() { return (timerNum() == 0) ? 54 : 55; };
+        static volatile void * const dmaPeripheralTxAddress() {
+            return &((timerNum() == 0) ? TPM0 : TPM1)->CONTROLS[channelNum()].CnV;
+        };
+    };
+
+    template<uint8_t periph_num>
+    struct DMA<TPM_Type*, periph_num> : DMA_KL_TX<TPM_Type*, periph_num> {
+        typedef DMA_KL_TX<TPM_Type*, periph_num> _tx;
+
+        constexpr DMA(const std::function<void(Interrupt::Type)> &handler) : _tx{handler} {};
+
+        void setInterrupts(const Interrupt::Type interrupts)
+        {
+            if ((interrupts != Interrupt::Off) && (interrupts & Interrupt::OnTxTransferDone)) {
+                _tx::setTxInterruptPriority(interrupts);
+                _tx::startTxDoneInterrupts();
+            } else {
+                _tx::stopTxDoneInterrupts();
+            }
+        };
+
+        bool reset() {
+            return _tx::resetTX();
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: KL05ZDMA_H_ONCE */
@@ -33,6 +33,7 @@
 
 #include "MotatePins.h"
 #include "MKL05Z4.h" // Redundant, but best to be explicit
+#include "KL05ZDMA.h"
 #include <type_traits>
 
 namespace Motate {
@@ -180,6 +181,16 @@ namespace Motate {
             spi_proxy.C1() &= ~SPI_C1_SPE_MASK;
         };
 
+        // With this on, SPTEF and SPRF request DMA transfers instead of interrupts.
+        static void setDMA(const bool value) {
+            if (value) {
+                spi_proxy.C1() &= ~(SPI_C1_SPIE_MASK | SPI_C1_SPTIE_MASK);
+                spi_proxy.C2() |= (SPI_C2_TXDMAE_MASK | SPI_C2_RXDMAE_MASK);
+            } else {
+                spi_proxy.C2() &= ~(SPI_C2_TXDMAE_MASK | SPI_C2_RXDMAE_MASK);
+            }
+        };
+
         static int16_t read(const bool lastXfer = false, uint8_t toSendAsNoop = 0) {
             // Yay SPI! As master we must write in order to read!
             // Logic here:
@@ -249,9 +260,30 @@ namespace Motate {
         static const uint8_t spiChannelNumber() { return SPIChipSelectPin<spiCSPinNumber>::csOffset; };
 
 
+        // DMA transfers, see startTransfer()
+        std::function<void(Interrupt::Type)> _dmaInterruptHandler;
+        DMA<SPI_Type*, 0> dma {_dmaInterruptHandler};
+
+        std::function<void(void)> transfer_done_callback;
+
         SPI(const uint32_t baud = 4000000, const uint16_t options = kSPI8Bit | kSPIMode0) {
             hardware.init();
             init(baud, options, /*fromConstructor =*/ true);
+
+            _dmaInterruptHandler = [&](Interrupt::Type cause) {
+                // The RX side finishes last, since every byte sent is also a byte received.
+                if (cause & Interrupt::OnRxTransferDone) {
+                    hardware.setDMA(false);
+                    if (transfer_done_callback) {
+                        transfer_done_callback();
+                    }
+                }
+#if IN_DEBUGGER == 1
+                if (cause & (Interrupt::OnTxError | Interrupt::OnRxError)) {
+                    __asm__("BKPT"); // DMA bus or configuration error
+                }
+#endif
+            };
         };
 
         void init(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
@@ -348,6 +380,48 @@ namespace Motate {
             
             return total_written;
         }
+
+        // Send size bytes from tx_buffer while receiving size bytes into rx_buffer, by DMA.
+        // Either may be nullptr, to send dummy bytes or throw away what's received.
+        // Returns false if a transfer is already running. transfer_done_callback is called from the
+        // interrupt once it's done.
+        bool startTransfer(uint8_t *tx_buffer, uint8_t *rx_buffer, uint16_t size) {
+            if (!dma.doneReading() || !dma.doneWriting()) {
+                return false;
+            }
+
+            // throw away anything left over from a blocking read or write
+            if (hardware.spi_proxy.S() & SPI_S_SPRF_MASK) {
+                (void)hardware.spi_proxy.D();
+            }
+
+            if (!dma.startRXTransfer(rx_buffer, size)) {
+                return false; // fail early
+            }
+            if (!dma.startTXTransfer(tx_buffer, size, /*handle_interrupts:*/ false)) {
+                dma.disableRx();
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // no transfer setup
+#endif
+                return false;
+            }
+
+            hardware.enable();
+            hardware.setDMA(true);
+            return true;
+        }
+
+        bool isTransferDone() {
+            return dma.doneReading();
+        }
+
+        void setTransferDoneCallback(const std::function<void()> &callback) {
+            transfer_done_callback = callback;
+        }
+
+        void setTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_done_callback = std::move(callback);
+        }
     };
     
 }
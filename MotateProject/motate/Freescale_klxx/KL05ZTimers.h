@@ -32,6 +32,7 @@
 
 #include "MKL05Z4.h"
 //#include "KL05ZCommon.h"
+#include "KL05ZDMA.h"
 
 namespace Motate {
     enum TimerMode {
@@ -420,6 +421,54 @@ namespace Motate {
         static void interrupt() __attribute__ ((weak));
     };
 
+    // A TimerChannel that can have its duty cycle fed by DMA, with one new value each period.
+    // This is separate from TimerChannel since each one needs a DMA channel, and there are only four.
+    template<uint8_t timerNum, uint8_t channelNum>
+    struct TimerChannelDMA : TimerChannel<timerNum, channelNum> {
+        typedef TimerChannel<timerNum, channelNum> _channel;
+
+        std::function<void(Interrupt::Type)> _dmaInterruptHandler;
+        DMA<TPM_Type *, (timerNum << 4) | channelNum> dma_ {_dmaInterruptHandler};
+
+        std::function<void(void)> transfer_done_callback;
+
+        TimerChannelDMA() : _channel{} { _init(); };
+        TimerChannelDMA(const TimerMode mode, const uint32_t freq) : _channel{mode, freq} { _init(); };
+
+        void _init() {
+            _dmaInterruptHandler = [&](Interrupt::Type cause) {
+                if ((cause & Interrupt::OnTxTransferDone) && transfer_done_callback) {
+                    transfer_done_callback();
+                }
+            };
+        };
+
+        // Send length values (from 0 .. TOP) to the channel, one each time the timer overflows.
+        bool startTransfer(uint16_t * const buffer, const uint16_t length) {
+            // The overflow flag is cleared by the DMA, so it can't also be used for interrupts
+            _channel::tc()->SC |= TPM_SC_DMA_MASK;
+            if (!dma_.startTXTransfer(buffer, length, /*handle_interrupts:*/ true, /*include_next:*/ false, /*byte_width:*/ 2)) {
+                return false;
+            }
+            _channel::start();
+            return true;
+        }
+        // This form allows passing a single-dimensional array by reference, and deduces the full length
+        template<typename T>
+        bool startTransfer(T &buffer) {
+            static_assert(std::alignment_of<T>::value == 2, "startTransfer(buffer): buffer must be an array of two-byte values");
+            return startTransfer((uint16_t *)(&buffer), std::extent<T>::value);
+        }
+
+        bool isTransferDone() {
+            return dma_.doneWriting();
+        }
+
+        void setTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_done_callback = std::move(callback);
+        }
+    };
+
 
 
     typedef const uint8_t timer_number;
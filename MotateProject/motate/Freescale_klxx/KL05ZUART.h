@@ -33,6 +33,7 @@
 
 #include "MotatePins.h"
 #include "MotateBuffer.h"
+#include "KL05ZDMA.h"
 #include <type_traits>
 #include <algorithm> // for std::max, etc.
 
@@ -280,6 +281,25 @@ namespace Motate {
             }
         };
 
+        // With these on, TDRE and RDRF request DMA transfers instead of interrupts.
+        void setTxDMA(bool value) {
+            if (value) {
+                uart_proxy.C2() &= ~(UART0_C2_TIE_MASK | UART0_C2_TCIE_MASK);
+                uart_proxy.C5() |= UART0_C5_TDMAE_MASK;
+            } else {
+                uart_proxy.C5() &= ~UART0_C5_TDMAE_MASK;
+            }
+        };
+
+        void setRxDMA(bool value) {
+            if (value) {
+                uart_proxy.C2() &= ~UART0_C2_RIE_MASK;
+                uart_proxy.C5() |= UART0_C5_RDMAE_MASK;
+            } else {
+                uart_proxy.C5() &= ~UART0_C5_RDMAE_MASK;
+            }
+        };
+
 
         static uint16_t getInterruptCause() __attribute__ (( noinline )) {
             uint16_t status = UARTInterrupt::Unknown;
@@ -345,9 +365,36 @@ namespace Motate {
         static _UARTHardware< UARTGetPeripheralNum<rxPinNumber, txPinNumber>::uartPeripheralNum > hardware;
         const inline uint8_t uartPeripheralNum() { return hardware.moduleId; };
 
+        // DMA transfers, for use with RXBuffer and TXBuffer (see MotateBuffer.h)
+        std::function<void(Interrupt::Type)> _dmaInterruptHandler;
+        DMA<UART0_Type*, 0> dma {_dmaInterruptHandler};
+
+        std::function<void(void)> transfer_rx_done_callback;
+        std::function<void(void)> transfer_tx_done_callback;
+
         UART(const uint32_t baud = 115200, const uint16_t options = UARTMode::As8N1) {
             hardware.init();
             init(baud, options, /*fromConstructor =*/ true);
+
+            _dmaInterruptHandler = [&](Interrupt::Type cause) {
+                if (cause & Interrupt::OnTxTransferDone) {
+                    hardware.setTxDMA(false);
+                    if (transfer_tx_done_callback) {
+                        transfer_tx_done_callback();
+                    }
+                }
+                if (cause & Interrupt::OnRxTransferDone) {
+                    hardware.setRxDMA(false);
+                    if (transfer_rx_done_callback) {
+                        transfer_rx_done_callback();
+                    }
+                }
+#if IN_DEBUGGER == 1
+                if (cause & (Interrupt::OnTxError | Interrupt::OnRxError)) {
+                    __asm__("BKPT"); // DMA bus or configuration error
+                }
+#endif
+            };
         };
 
         void init(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
@@ -452,6 +499,50 @@ namespace Motate {
 
             return total_written;
         };
+
+        // **** DMA transfers
+        // These have the same interface as on the SAM, so this can be the owner of an RXBuffer or TXBuffer.
+
+        // The KL05Z DMA can only do one block, so buffer2 and length2 are ignored
+        bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2 = nullptr, const uint16_t length2 = 0) {
+            if (!dma.startRXTransfer(buffer, length)) {
+                return false;
+            }
+            hardware.setRxDMA(true);
+            return true;
+        };
+
+        char* getRXTransferPosition() {
+            return dma.getRXTransferPosition();
+        };
+
+        void setRXTransferDoneCallback(const std::function<void()> &callback) {
+            transfer_rx_done_callback = callback;
+        }
+
+        void setRXTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_rx_done_callback = std::move(callback);
+        }
+
+        bool startTXTransfer(char *buffer, const uint16_t length) {
+            if (!dma.startTXTransfer(buffer, length)) {
+                return false;
+            }
+            hardware.setTxDMA(true);
+            return true;
+        };
+
+        char* getTXTransferPosition() {
+            return dma.getTXTransferPosition();
+        };
+
+        void setTXTransferDoneCallback(const std::function<void()> &callback) {
+            transfer_tx_done_callback = callback;
+        }
+
+        void setTXTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_tx_done_callback = std::move(callback);
+        }
     };
 
     struct _UARTHardwareProxy {
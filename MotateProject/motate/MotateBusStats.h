@@ -0,0 +1,188 @@
+/*
+  MotateBusStats.h - Optional bus transaction statistics for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATEBUSSTATS_H_ONCE
+#define MOTATEBUSSTATS_H_ONCE
+
+#include <cinttypes>
+
+/* Per-device statistics for SPIBus and TWIBus.
+ *
+ * Set MOTATE_BUS_STATS to 1 (in the Makefile or before including any Motate headers) to turn
+ * these on. When off (the default) none of this is compiled, and the messages and devices are
+ * the same size as without it.
+ *
+ * Times are in core clock cycles from the DWT cycle counter:
+ *  - queued: from when the message was queued to when it started on the wire
+ *  - wire:   from when it started to when its done interrupt came in
+ *
+ * Each has a fixed histogram of kHistogramBuckets power-of-two buckets. Bucket 0 is anything
+ * under (2 << kHistogramShift) cycles, and each bucket after that is twice as wide as the one
+ * before it, with the last one catching everything longer.
+ */
+
+#ifndef MOTATE_BUS_STATS
+#define MOTATE_BUS_STATS 0
+#endif
+
+#if MOTATE_BUS_STATS == 1
+
+#include "MotatePins.h" // Grab the platform-specific libraries for DWT and CoreDebug
+
+namespace Motate {
+
+    struct BusStats {
+        static constexpr uint8_t kHistogramBuckets = 16;
+        static constexpr uint8_t kHistogramShift   = 6;
+
+        uint32_t messages = 0;
+        uint32_t bytes    = 0;
+        uint32_t nacks    = 0;
+        uint32_t errors   = 0;
+
+        uint64_t queued_cycles_total = 0;
+        uint64_t wire_cycles_total   = 0;
+        uint32_t queued_cycles_max   = 0;
+        uint32_t wire_cycles_max     = 0;
+
+        uint32_t queued_histogram[kHistogramBuckets] = {};
+        uint32_t wire_histogram[kHistogramBuckets]   = {};
+
+        // This is harmless to call more than once, and the buses call it from init().
+        static void enableCycleCounter() {
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        };
+
+        static uint32_t now() { return DWT->CYCCNT; };
+
+        static uint8_t bucketFor(uint32_t cycles) {
+            cycles >>= kHistogramShift;
+            if (cycles < 2) {
+                return 0;
+            }
+            uint8_t bucket = 31 - __builtin_clz(cycles);
+            return (bucket < kHistogramBuckets) ? bucket : (kHistogramBuckets - 1);
+        };
+
+        // Called from the bus interrupt when a message is done.
+        void record(const uint32_t queued_at, const uint32_t started_at, const uint32_t done_at,
+                    const uint32_t size, const bool nack, const bool error) {
+            const uint32_t queued_cycles = started_at - queued_at;
+            const uint32_t wire_cycles   = done_at - started_at;
+
+            messages++;
+            bytes += size;
+            if (nack) { nacks++; }
+            if (error) { errors++; }
+
+            queued_cycles_total += queued_cycles;
+            wire_cycles_total += wire_cycles;
+            if (queued_cycles > queued_cycles_max) { queued_cycles_max = queued_cycles; }
+            if (wire_cycles > wire_cycles_max) { wire_cycles_max = wire_cycles; }
+
+            queued_histogram[bucketFor(queued_cycles)]++;
+            wire_histogram[bucketFor(wire_cycles)]++;
+        };
+
+        void reset() { *this = BusStats{}; };
+
+        // Write a summary to a Debug (see MotateDebug.h), or anything else with write(const char*, int32_t).
+        // The numbers may be from different messages if this is interrupted by the bus.
+        template <typename debug_t>
+        void report(debug_t &debug, const char *name) const {
+            // name is written on its own, so it can be any length
+            debug.write(name, _length(name));
+
+            // the labels, and the most digits each of the six numbers can have
+            char line[sizeof(" msgs= bytes= nack= err= qmax= wmax=\n") - 1 + 6 * kMaxUIntDigits];
+            char *p = line;
+
+            p = _append(p, " msgs=");
+            p = _appendUInt(p, messages);
+            p = _append(p, " bytes=");
+            p = _appendUInt(p, bytes);
+            p = _append(p, " nack=");
+            p = _appendUInt(p, nacks);
+            p = _append(p, " err=");
+            p = _appendUInt(p, errors);
+            p = _append(p, " qmax=");
+            p = _appendUInt(p, queued_cycles_max);
+            p = _append(p, " wmax=");
+            p = _appendUInt(p, wire_cycles_max);
+            p = _append(p, "\n");
+            debug.write(line, p - line);
+
+            _reportHistogram(debug, " q:", queued_histogram);
+            _reportHistogram(debug, " w:", wire_histogram);
+        };
+
+        static constexpr uint8_t kMaxUIntDigits = 10; // 4294967295
+
+        template <typename debug_t, uint32_t label_size>
+        static void _reportHistogram(debug_t &debug, const char (&label)[label_size], const uint32_t (&histogram)[kHistogramBuckets]) {
+            // the label (without its NUL), a space and a number per bucket, and the newline
+            char line[(label_size - 1) + kHistogramBuckets * (1 + kMaxUIntDigits) + 1];
+            char *p = _append(line, label);
+            for (uint8_t i = 0; i < kHistogramBuckets; i++) {
+                p = _append(p, " ");
+                p = _appendUInt(p, histogram[i]);
+            }
+            p = _append(p, "\n");
+            debug.write(line, p - line);
+        };
+
+        static int32_t _length(const char *s) {
+            int32_t length = 0;
+            while (s[length]) { length++; }
+            return length;
+        };
+
+        static char *_append(char *p, const char *s) {
+            while (*s) { *p++ = *s++; }
+            return p;
+        };
+
+        static char *_appendUInt(char *p, uint32_t value) {
+            char digits[10];
+            uint8_t count = 0;
+            do {
+                digits[count++] = '0' + (value % 10);
+                value /= 10;
+            } while (value);
+            while (count) { *p++ = digits[--count]; }
+            return p;
+        };
+    };
+
+} // namespace Motate
+
+#endif // MOTATE_BUS_STATS == 1
+
+#endif /* end of include guard: MOTATEBUSSTATS_H_ONCE */
@@ -926,6 +926,8 @@ namespace Motate {
      *
      * SPI uses these pins to wire up pin muxing and handle tests if pins can support SPI.
      *
+     * The spiNum is processor-specific. (On the Sams, 4 and up are USARTs in SPI mode.)
+     *
      * REQUIRES: _MAKE_MOTATE_SPI_CS_PIN
      *           _MAKE_MOTATE_SPI_MISO_PIN
      *           _MAKE_MOTATE_SPI_MOSI_PIN
@@ -0,0 +1,194 @@
+/*
+  MotateReadiness.h - Wait for any of several streams to be ready, for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATEREADINESS_H_ONCE
+#define MOTATEREADINESS_H_ONCE
+
+#include <cinttypes>
+#include <atomic>
+#include <functional>
+#include "MotatePins.h" // Grab the platform-specific libraries for __WFE and __SEV
+
+/* A ReadinessSet lets the main loop sleep until one of several streams needs looking at, instead of
+ * polling each of them every time around.
+ *
+ * UART, USBSerial and SPIBus devices each have a ReadinessSource named readiness. Interest in one or
+ * more events of a source is registered with watch(), which hands back the bit that will be raised:
+ *
+ *   ReadinessSet ready;
+ *   const uint32_t usb_rx    = ready.watch(SerialUSB.readiness, Readiness::kReadable);
+ *   const uint32_t uart_tx   = ready.watch(uart.readiness, Readiness::kWritable);
+ *   const uint32_t motor_msg = ready.watch(motor_device.readiness, Readiness::kDone);
+ *
+ *   while (1) {
+ *       const uint32_t ready_bits = ready.wait(); // WFE until something is raised
+ *       if (ready_bits & usb_rx) { ... }
+ *       ...
+ *   }
+ *
+ * The streams raise the bits from their interrupts:
+ *  - kReadable when data has arrived (watching it turns on the UART RX time-out, or the USB per-packet
+ *    OUT interrupt, if they aren't on already)
+ *  - kWritable when a transmit has finished, so there's room to send more
+ *  - kDone when a queued write or bus message is done
+ *
+ * Bits stay raised until they are taken by wait() or take(), so anything raised between taking
+ * them and handling the stream isn't lost. At worst a stream is looked at once with nothing to do.
+ *
+ * A source reports to one set, and a set has 32 bits. Several events (or several sources) may
+ * share a bit by passing it to watch().
+ */
+
+namespace Motate {
+
+    struct Readiness {
+        using Type = uint8_t;
+
+        static constexpr Type kReadable = 1 << 0;
+        static constexpr Type kWritable = 1 << 1;
+        static constexpr Type kDone     = 1 << 2;
+
+        static constexpr uint8_t kEventCount = 3;
+    };
+
+    struct ReadinessSet;
+
+    struct ReadinessSource {
+        ReadinessSet *_set = nullptr;
+        uint32_t      _bits[Readiness::kEventCount] = {};
+
+        // Called by ReadinessSet::watch() with the events now watched, so the stream can turn on what
+        // it needs to raise them. Set by the stream, may be empty.
+        std::function<void(const Readiness::Type events)> watched_callback;
+
+        bool isWatched(const Readiness::Type events) const {
+            for (uint8_t i = 0; i < Readiness::kEventCount; i++) {
+                if ((events & (1 << i)) && _bits[i]) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // Called by the stream, usually from an interrupt
+        void notify(const Readiness::Type events);
+    };
+
+    struct ReadinessSet {
+        std::atomic<uint32_t> _raised{0};
+        uint32_t              _allocated = 0;
+
+        // Have events on source raise bit (or a new bit, if bit is 0), and return the bit.
+        // Returns 0 if there are no bits left, or if source already reports to another set.
+        // Call this before the stream is started.
+        uint32_t watch(ReadinessSource &source, const Readiness::Type events, uint32_t bit = 0) {
+            if ((source._set != nullptr) && (source._set != this)) {
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // a source can only report to one set
+#endif
+                return 0;
+            }
+
+            if (bit == 0) {
+                bit = ~_allocated & (_allocated + 1); // lowest free bit
+                if (bit == 0) {
+#if IN_DEBUGGER == 1
+                    __asm__("BKPT"); // out of bits
+#endif
+                    return 0;
+                }
+            }
+            _allocated |= bit;
+
+            for (uint8_t i = 0; i < Readiness::kEventCount; i++) {
+                if (events & (1 << i)) {
+                    source._bits[i] |= bit;
+                }
+            }
+            source._set = this;
+            if (source.watched_callback) {
+                source.watched_callback(events);
+            }
+            return bit;
+        };
+
+        // Safe to call from any context, including interrupts.
+        void raise(const uint32_t bits) {
+            _raised.fetch_or(bits);
+            _signal();
+        };
+
+        // Take (and clear) the raised bits in mask, without waiting.
+        uint32_t take(const uint32_t mask = 0xFFFFFFFF) {
+            return _raised.fetch_and(~mask) & mask;
+        };
+
+        // Sleep until any of the bits in mask are raised, then take and return them.
+        uint32_t wait(const uint32_t mask = 0xFFFFFFFF) {
+            uint32_t bits;
+            while ((bits = take(mask)) == 0) {
+                // If a bit was raised after the take(), the SEV in raise() makes this return at once
+                _sleep();
+            }
+            return bits;
+        };
+
+        static void _signal() {
+#if defined(__arm__)
+            __SEV();
+#endif
+        };
+
+        static void _sleep() {
+#if defined(__arm__)
+            __WFE();
+#endif
+        };
+    };
+
+    inline void ReadinessSource::notify(const Readiness::Type events) {
+        ReadinessSet *set = _set;
+        if (set == nullptr) {
+            return;
+        }
+
+        uint32_t bits = 0;
+        for (uint8_t i = 0; i < Readiness::kEventCount; i++) {
+            if (events & (1 << i)) {
+                bits |= _bits[i];
+            }
+        }
+        if (bits) {
+            set->raise(bits);
+        }
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATEREADINESS_H_ONCE */
@@ -33,6 +33,8 @@
 #include <cinttypes>
 #include "MotateCommon.h"
 #include "MotateServiceCall.h"
+#include "MotateBusStats.h"
+#include "MotateReadiness.h"
 #include <atomic>
 
 
@@ -108,6 +110,8 @@ namespace Motate {
 
 
     struct SPIInterrupt : Interrupt {
+        // Slave mode only: the master released NSS (the end of a frame)
+        static constexpr uint16_t OnCSDeasserted = 1<<9;
     };
 
 #pragma mark SPIBusDeviceBase
@@ -132,6 +136,14 @@ namespace Motate {
         virtual uint32_t getChannelID() const { return 0; };
         // return an index to this device's channel - may be different from the channel ID
         virtual uint32_t getChannel() const { return 0; };
+
+        // kDone is raised by the Bus when one of this device's messages is done, see MotateReadiness.h
+        ReadinessSource readiness;
+
+#if MOTATE_BUS_STATS == 1
+        // maintained by the Bus, see MotateBusStats.h
+        BusStats stats;
+#endif
     };
 } // namespace Motate
 
@@ -172,6 +184,11 @@ namespace Motate {
         std::function<void(void)> message_done_callback;
         volatile State state = State::Idle;
 
+#if MOTATE_BUS_STATS == 1
+        uint32_t _stats_queued_at  = 0;
+        uint32_t _stats_started_at = 0;
+#endif
+
 
         SPIMessage() {
             // manage the linked list
@@ -301,10 +318,17 @@ namespace Motate {
             });
             hardware.setInterrupts(kInterruptPriorityLow); // enable interrupts and set the priority
             hardware.enable();
+
+#if MOTATE_BUS_STATS == 1
+            BusStats::enableCycleCounter();
+#endif
         };
 
         // DO NOT DIRECT CALL THIS - call device->queueMessage instead!
         void queueMessageFromDevice (SPIMessage *msg) {
+#if MOTATE_BUS_STATS == 1
+            msg->_stats_queued_at = BusStats::now();
+#endif
             if (_next_message_to_send == nullptr) {
                 // first one in the queue!
                 _next_message_to_send = msg;
@@ -337,6 +361,9 @@ namespace Motate {
             _next_message_to_send->state = SPIMessage::State::Sending;
             _current_transaction_device = _next_message_to_send->device;
             hardware.setChannel(_current_transaction_device, _next_message_to_send->deassert_after);
+#if MOTATE_BUS_STATS == 1
+            _next_message_to_send->_stats_started_at = BusStats::now();
+#endif
             hardware.startTransfer(_next_message_to_send->tx_buffer, _next_message_to_send->rx_buffer, _next_message_to_send->size);
         }
 
@@ -367,6 +394,14 @@ namespace Motate {
                     // Then grab the (only) Sending message and mark it Done, then call it's done callback.
                     this_message->state = SPIMessage::State::Done;
 
+#if MOTATE_BUS_STATS == 1
+                    // before the callback, since it may re-queue the message
+                    if (this_message->device) {
+                        this_message->device->stats.record(this_message->_stats_queued_at, this_message->_stats_started_at,
+                                                           BusStats::now(), this_message->size, false, false);
+                    }
+#endif
+
                     // Set the values for *this* message before the callback, so
                     // the callback can re-queue with different values AND tell us
                     // how to handle the rest of this transaction. With these defaulted
@@ -388,6 +423,10 @@ namespace Motate {
                         this_message->message_done_callback();
                     }
 
+                    if (this_message->device) {
+                        this_message->device->readiness.notify(Readiness::kDone);
+                    }
+
                     if (this_message->immediate_ends_transaction) {
                         _current_transaction_device = nullptr;
                     }
@@ -468,5 +507,143 @@ namespace Motate {
 
     }; // SPIBus
 
+
+#pragma mark SPISlave
+    /**************************************************
+     *
+     * SPI Slave, for using the SPI peripheral as a DMA-driven link to another board
+     *
+     * This follows the same owner contract as UART (start/get/set RX and TX transfer),
+     * so RXBuffer and TXBuffer can be used on top of it unchanged.
+     *
+     * The hardware keeps one region active and one queued per direction, so there's
+     * always somewhere for incoming data to go as long as the owner keeps up.
+     * frame_done_callback is called (from the interrupt) when the master releases
+     * NSS, which is the only framing we have.
+     *
+     * If the master clocks when there's nothing queued to send, the SPI resends the
+     * last character it had, so the protocol on top should be able to ignore that.
+     *
+     **************************************************/
+
+    template<pin_number spiMISOPinNumber, pin_number spiMOSIPinNumber, pin_number spiSCKPinNumber, pin_number spiCSPinNumber>
+    struct SPISlave
+    {
+        static_assert(IsSPIMISOPin<spiMISOPinNumber>(),
+                      "SPI MISO Pin is not on a hardware SPI.");
+
+        static_assert(IsSPIMOSIPin<spiMOSIPinNumber>(),
+                      "SPI MOSI Pin is not on a hardware SPI.");
+
+        static_assert(IsSPISCKPin<spiSCKPinNumber>(),
+                      "SPI SCK Pin is not on a hardware SPI.");
+
+        static_assert(IsSPICSPin<spiCSPinNumber>(),
+                      "SPI CS Pin is not on a hardware SPI.");
+
+        static_assert((SPIMISOPin<spiMISOPinNumber>::spiNum == SPIMOSIPin<spiMOSIPinNumber>::spiNum) &&
+                      (SPIMOSIPin<spiMOSIPinNumber>::spiNum == SPISCKPin<spiSCKPinNumber>::spiNum) &&
+                      (SPISCKPin<spiSCKPinNumber>::spiNum == SPIChipSelectPin<spiCSPinNumber>::spiNum),
+                      "SPI MISO, MOSI, SCK, and CS pins are not all on the same SPI hardware peripheral.");
+
+        static_assert(SPIChipSelectPin<spiCSPinNumber>::csNumber == 0,
+                      "SPI slave CS pin must be NPCS0 (the NSS input).");
+
+        SPIMISOPin<spiMISOPinNumber> misoPin {};
+        SPIMOSIPin<spiMOSIPinNumber> mosiPin {};
+        SPISCKPin<spiSCKPinNumber> sckPin {};
+        SPIChipSelectPin<spiCSPinNumber> csPin {};
+
+        SPISlaveGetHardware<spiMISOPinNumber, spiMOSIPinNumber, spiSCKPinNumber> hardware;
+
+        std::function<void(void)> transfer_rx_done_callback;
+        std::function<void(void)> transfer_tx_done_callback;
+        std::function<void(void)> frame_done_callback;
+
+        const uint16_t _options;
+
+        // Like SPIBus, the hardware isn't touched until init() is called
+        SPISlave(const uint16_t options = kSPIMode0 | kSPI8Bit) : hardware{}, _options{options} {};
+
+        // prevent copying, the interrupt handler captures this
+        SPISlave(const SPISlave&) = delete;
+
+        void init() {
+            hardware.init();
+            hardware.setOptions(_options);
+            hardware.setInterruptHandler([&](Interrupt::Type cause) { this->spiInterruptHandler(cause); });
+            hardware.setInterrupts(SPIInterrupt::OnCSDeasserted | SPIInterrupt::OnRxError | SPIInterrupt::PriorityHigh);
+            hardware.enable();
+        };
+
+        void setFrameDoneCallback(std::function<void()> &&callback) {
+            frame_done_callback = std::move(callback);
+        }
+
+        // *** RX
+
+        // The second region is queued behind the first, so the DMA moves straight on to it.
+        bool startRXTransfer(char *&buffer, uint16_t length, char *&buffer2, uint16_t length2) {
+            if (length == 0) { return false; }
+            if (!hardware.startRXTransfer(buffer, length)) { return false; }
+            if (length2 > 0) {
+                // if there's no room to queue it now, it'll be asked for again
+                hardware.startRXTransfer(buffer2, length2);
+            }
+            return true;
+        };
+
+        char* getRXTransferPosition() {
+            return hardware.getRXTransferPosition();
+        };
+
+        void setRXTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_rx_done_callback = std::move(callback);
+        }
+
+        // *** TX
+
+        bool startTXTransfer(char *buffer, const uint16_t length) {
+            return hardware.startTXTransfer(buffer, length);
+        };
+
+        char* getTXTransferPosition() {
+            return hardware.getTXTransferPosition();
+        };
+
+        void setTXTransferDoneCallback(std::function<void()> &&callback) {
+            transfer_tx_done_callback = std::move(callback);
+        }
+
+        // *** Handling interrupts
+
+        void spiInterruptHandler(Interrupt::Type interruptCause) {
+            if (interruptCause & SPIInterrupt::OnRxError) {
+                // uh oh, we just lost data!
+#if IN_DEBUGGER == 1
+                __asm__("BKPT"); // SPI slave overrun!
+#endif
+            }
+
+            if (interruptCause & SPIInterrupt::OnTxTransferDone) {
+                if (transfer_tx_done_callback) {
+                    transfer_tx_done_callback();
+                }
+            }
+
+            if (interruptCause & SPIInterrupt::OnRxTransferDone) {
+                if (transfer_rx_done_callback) {
+                    transfer_rx_done_callback();
+                }
+            }
+
+            if (interruptCause & SPIInterrupt::OnCSDeasserted) {
+                if (frame_done_callback) {
+                    frame_done_callback();
+                }
+            }
+        };
+    }; // SPISlave
+
 } // namespace Motate
 #endif /* end of include guard: MOTATESPI_H_ONCE */
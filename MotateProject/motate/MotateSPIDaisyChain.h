@@ -0,0 +1,311 @@
+/*
+  MotateSPIDaisyChain.h - Daisy-chained SPI device helper for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATESPIDAISYCHAIN_H_ONCE
+#define MOTATESPIDAISYCHAIN_H_ONCE
+
+#include <cinttypes>
+#include <atomic>
+#include <functional>
+#include "MotateSPI.h"
+
+/* SPIDaisyChain drives a chain of TMC-style stepper drivers that share one chip select,
+ * with each driver's SDO wired to the next driver's SDI.
+ *
+ * Each driver uses a 40-bit datagram:
+ *   TX: [address | 0x80 for write] [data 31..24] [data 23..16] [data 15..8] [data 7..0]
+ *   RX: [status]                   [data 31..24] [data 23..16] [data 15..8] [data 7..0]
+ *
+ * The response clocked out during a transfer belongs to the datagram sent in the
+ * *previous* transfer, so reads are pipelined by one frame.
+ *
+ * In a chain of N drivers, the first datagram shifted out ends up in the driver furthest
+ * from MOSI, and the first response shifted in comes from that same driver. So driver i
+ * (0 being the driver wired to MOSI) uses offset (N-1-i)*5 in both the TX and RX frames.
+ *
+ * Every driver must get a datagram every frame, so a driver with nothing to do is sent a
+ * read of its idle address, which is harmless.
+ *
+ * Register writes go into a small per-driver shadow table. Writing the value that was last
+ * sent does nothing, and writing the same register twice before it goes out only sends the
+ * last value. Frames are only sent when at least one driver has something to say.
+ */
+
+namespace Motate {
+
+    template <typename device_t, uint8_t driver_count, uint8_t shadow_slots = 16>
+    struct SPIDaisyChain {
+        static_assert(driver_count > 0, "SPIDaisyChain needs at least one driver.");
+        static_assert(shadow_slots <= 32, "SPIDaisyChain supports at most 32 shadow registers per driver.");
+
+        static constexpr uint8_t  kDatagramSize = 5;
+        static constexpr uint8_t  kWriteFlag    = 0x80;
+        static constexpr uint8_t  kAddressMask  = 0x7F;
+        static constexpr uint16_t kFrameSize    = driver_count * kDatagramSize;
+
+        // the chip select is shared, so there's just one device on the bus for the whole chain
+        device_t _device;
+
+        SPIMessage _message;
+
+        // DMA may write in whole words, so we keep the buffers word-aligned
+        alignas(4) uint8_t _tx_frame[kFrameSize];
+        alignas(4) uint8_t _rx_frame[kFrameSize + 4];
+
+        struct ShadowRegister {
+            uint8_t  address   = 0;
+            bool     used      = false;
+            uint32_t value     = 0;  // the value to send
+            uint32_t sent      = 0;  // the value last sent (valid if ever_sent)
+            bool     ever_sent = false;
+        };
+
+        struct Driver {
+            ShadowRegister        shadow[shadow_slots];
+            std::atomic<uint32_t> dirty{0};  // one bit per shadow slot
+
+            // one bit per register address (0-127) that has a read requested
+            std::atomic<uint32_t> read_requests[4];
+
+            // what was sent in the last frame, so we know what the response is for
+            uint8_t last_address   = 0;
+            bool    last_requested = false;  // last datagram was a requested read (not an idle read)
+
+            uint8_t idle_address = 0x6F;  // DRV_STATUS on TMC2130/5160
+            uint8_t status       = 0;
+
+            Driver() {
+                for (auto &r : read_requests) { r = 0; }
+            };
+        };
+
+        Driver _drivers[driver_count];
+
+        std::atomic<bool> _in_flight{false};
+
+        // Called (from interrupt context) for every read response.
+        // Parameters: driver index, register address, value, and the SPI status byte.
+        std::function<void(uint8_t, uint8_t, uint32_t, uint8_t)> read_done_callback;
+
+        // Called (from interrupt context) after each frame has been scattered back to the drivers.
+        std::function<void(void)> frame_done_callback;
+
+        SPIDaisyChain(device_t &&device) : _device{std::move(device)} {
+            _message.message_done_callback = [&]() { this->_frameDone(); };
+        };
+
+        // prevent copying, the message callback captures this
+        SPIDaisyChain(const SPIDaisyChain &) = delete;
+
+        void setIdleAddress(const uint8_t driver, const uint8_t address) {
+            _drivers[driver].idle_address = address & kAddressMask;
+        };
+
+        uint8_t getStatus(const uint8_t driver) const { return _drivers[driver].status; };
+
+        // Set a register value. Nothing is sent until update() is called.
+        // Returns false if the shadow table for this driver is full.
+        bool writeRegister(const uint8_t driver, const uint8_t address, const uint32_t value) {
+            if (driver >= driver_count) { return false; }
+            Driver &d = _drivers[driver];
+
+            int8_t slot = _findSlot(d, address & kAddressMask);
+            if (slot < 0) { return false; }
+
+            ShadowRegister &r = d.shadow[slot];
+            r.value = value;
+            if (r.ever_sent && (r.sent == value)) {
+                // coalesced back to what the driver already has
+                d.dirty.fetch_and(~(1u << slot));
+            } else {
+                d.dirty.fetch_or(1u << slot);
+            }
+            return true;
+        };
+
+        // Force a register to be re-sent, even if it matches what was last sent.
+        void markDirty(const uint8_t driver, const uint8_t address) {
+            if (driver >= driver_count) { return; }
+            Driver &d = _drivers[driver];
+
+            const uint8_t a = address & kAddressMask;
+            for (uint8_t i = 0; i < shadow_slots; i++) {
+                if (d.shadow[i].used && (d.shadow[i].address == a)) {
+                    d.dirty.fetch_or(1u << i);
+                    return;
+                }
+            }
+        };
+
+        // Request a read. The result is delivered to read_done_callback.
+        // Repeated requests for the same register before it's read are coalesced.
+        void readRegister(const uint8_t driver, const uint8_t address) {
+            if (driver >= driver_count) { return; }
+            const uint8_t a = address & kAddressMask;
+            _drivers[driver].read_requests[a >> 5].fetch_or(1u << (a & 31));
+        };
+
+        bool isBusy() const { return _in_flight.load(); };
+
+        // Build and queue a frame if any driver needs one. Safe to call from the main loop
+        // or from a timer. Returns true if a frame was queued (or one is already in flight).
+        bool update() {
+            if (_in_flight.exchange(true)) {
+                // the current frame's done callback will call us again
+                return true;
+            }
+
+            if (!_buildFrame()) {
+                _in_flight.store(false);
+                return false;
+            }
+
+            _message.setup(_tx_frame, _rx_frame, kFrameSize, SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+            _device.queueMessage(&_message);
+            return true;
+        };
+
+        int8_t _findSlot(Driver &d, const uint8_t address) {
+            int8_t free_slot = -1;
+            for (uint8_t i = 0; i < shadow_slots; i++) {
+                if (d.shadow[i].used) {
+                    if (d.shadow[i].address == address) { return i; }
+                } else if (free_slot < 0) {
+                    free_slot = i;
+                }
+            }
+            if (free_slot >= 0) {
+                d.shadow[free_slot].address = address;
+                d.shadow[free_slot].used    = true;
+            }
+            return free_slot;
+        };
+
+        // Returns true if there is anything worth sending.
+        bool _buildFrame() {
+            bool needed = false;
+            bool requested[driver_count];
+
+            for (uint8_t i = 0; i < driver_count; i++) {
+                Driver  &d         = _drivers[i];
+                uint8_t *datagram  = _tx_frame + ((driver_count - 1 - i) * kDatagramSize);
+                uint8_t  address   = d.idle_address;
+                uint32_t value     = 0;
+                bool     is_write  = false;
+
+                requested[i] = false;
+
+                // a read requested last frame needs this frame to clock out its response
+                if (d.last_requested) { needed = true; }
+
+                uint32_t dirty = d.dirty.load();
+                if (dirty) {
+                    uint8_t slot = __builtin_ctz(dirty);
+                    d.dirty.fetch_and(~(1u << slot));
+
+                    ShadowRegister &r = d.shadow[slot];
+                    address     = r.address;
+                    value       = r.value;
+                    r.sent      = value;
+                    r.ever_sent = true;
+                    is_write    = true;
+                    needed      = true;
+                } else {
+                    for (uint8_t w = 0; w < 4; w++) {
+                        uint32_t requests = d.read_requests[w].load();
+                        if (requests) {
+                            uint8_t bit = __builtin_ctz(requests);
+                            d.read_requests[w].fetch_and(~(1u << bit));
+                            address      = (w << 5) | bit;
+                            requested[i] = true;
+                            needed       = true;
+                            break;
+                        }
+                    }
+                }
+
+                datagram[0] = is_write ? (address | kWriteFlag) : address;
+                datagram[1] = (value >> 24) & 0xFF;
+                datagram[2] = (value >> 16) & 0xFF;
+                datagram[3] = (value >> 8) & 0xFF;
+                datagram[4] = (value >> 0) & 0xFF;
+            }
+
+            if (!needed) {
+                // we didn't consume anything, so nothing needs to be remembered
+                return false;
+            }
+
+            // only now commit what the responses in the next frame will belong to
+            for (uint8_t i = 0; i < driver_count; i++) {
+                const uint8_t *datagram    = _tx_frame + ((driver_count - 1 - i) * kDatagramSize);
+                _drivers[i].last_address   = datagram[0] & kAddressMask;
+                _drivers[i].last_requested = requested[i];
+            }
+
+            return true;
+        };
+
+        // Called from the SPI interrupt when the frame is done. Responses in _rx_frame are for
+        // the datagrams of the frame *before* this one, which is what _response_address holds.
+        uint8_t _response_address[driver_count] = {};
+        bool    _response_is_read[driver_count] = {};
+
+        void _frameDone() {
+            for (uint8_t i = 0; i < driver_count; i++) {
+                Driver        &d        = _drivers[i];
+                const uint8_t *response = _rx_frame + ((driver_count - 1 - i) * kDatagramSize);
+
+                d.status = response[0];
+
+                if (_response_is_read[i] && read_done_callback) {
+                    uint32_t value = ((uint32_t)response[1] << 24) | ((uint32_t)response[2] << 16) |
+                                     ((uint32_t)response[3] << 8) | ((uint32_t)response[4] << 0);
+                    read_done_callback(i, _response_address[i], value, d.status);
+                }
+
+                // what we just sent is what the next response will be for
+                _response_address[i] = d.last_address;
+                _response_is_read[i] = d.last_requested;
+            }
+
+            if (frame_done_callback) {
+                frame_done_callback();
+            }
+
+            _in_flight.store(false);
+
+            // keep going while there's anything left, including pending read responses
+            update();
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATESPIDAISYCHAIN_H_ONCE */
@@ -0,0 +1,411 @@
+/*
+  MotateSPIFlash.h - SPI NOR flash (W25Q-style) driver for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATESPIFLASH_H_ONCE
+#define MOTATESPIFLASH_H_ONCE
+
+#include <cinttypes>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include "MotateSPI.h"
+#include "MotateTimers.h"
+
+/* SPIFlash is a non-blocking driver for 24-bit addressed SPI NOR flash (W25Q and friends).
+ *
+ * All work is done through one SPIMessage, driven by a small state machine that runs from
+ * the message's done callback (interrupt context). Requests (read, program, erase) go into
+ * a fixed-size queue and are handled in order. The completion callbacks are called from
+ * interrupt context.
+ *
+ * Reads go through a small LRU cache of cache_line_size byte lines, filled with FAST_READ.
+ * Each line carries its own five byte command header in front of the data, so a line is
+ * filled with a single DMA transfer directly into place. (The transmit and receive buffers
+ * can be the same memory, since each byte is sent before its replacement arrives.)
+ *
+ * Programs are split at page boundaries, and each page (and each erase) is sent as
+ * WRITE ENABLE, the command itself, then READ STATUS repeated until the busy bit clears.
+ * Any cache lines touched by a program or erase are invalidated.
+ *
+ * The busy bit is polled at most once per SysTick (ms), and the bus is free for other devices
+ * between polls. update() sends the next poll when it's due, so it must be called once per tick
+ * (from a SysTickEvent or the main loop) for programs and erases to finish.
+ */
+
+namespace Motate {
+
+    template <typename device_t, uint16_t cache_line_size = 256, uint8_t cache_lines = 4, uint8_t queue_depth = 8>
+    struct SPIFlash {
+        static_assert(cache_lines > 0, "SPIFlash needs at least one cache line.");
+        static_assert((cache_line_size & (cache_line_size - 1)) == 0, "SPIFlash cache_line_size must be a power of two.");
+        static_assert((queue_depth & (queue_depth - 1)) == 0, "SPIFlash queue_depth must be a power of two.");
+
+        enum Command : uint8_t {
+            kWriteEnable        = 0x06,
+            kReadStatus1        = 0x05,
+            kFastRead           = 0x0B,
+            kPageProgram        = 0x02,
+            kSectorErase4K      = 0x20,
+            kBlockErase64K      = 0xD8,
+        };
+
+        static constexpr uint8_t  kStatusBusy       = 0x01;
+        static constexpr uint16_t kPageSize         = 256;
+        static constexpr uint8_t  kAddressHeader    = 4;  // command + 24-bit address
+        static constexpr uint8_t  kFastReadHeader   = 5;  // command + 24-bit address + dummy byte
+        static constexpr uint32_t kCacheLineMask    = ~((uint32_t)cache_line_size - 1);
+
+        enum class OperationType : uint8_t {
+            Read,
+            Program,
+            Erase4K,
+            Erase64K,
+        };
+
+        struct Operation {
+            OperationType type;
+            uint32_t address;
+            union {
+                uint8_t       *read_to;
+                const uint8_t *program_from;
+            };
+            uint16_t length;
+            std::function<void(void)> done_callback;
+        };
+
+        enum class State : uint8_t {
+            Idle,
+            FillLine,
+            WriteEnable,
+            Program,
+            Erase,
+            PollStatus,
+            PollWait,
+        };
+
+        struct CacheLine {
+            uint32_t address  = 0;
+            uint32_t last_use = 0;
+            bool     valid    = false;
+            uint8_t  raw[kFastReadHeader + cache_line_size];
+
+            uint8_t *data() { return raw + kFastReadHeader; };
+        };
+
+        device_t   _device;
+        SPIMessage _message;
+
+        CacheLine _lines[cache_lines];
+        uint32_t  _use_counter = 0;
+
+        // used for everything that isn't a cache line fill
+        uint8_t _scratch[kAddressHeader + kPageSize];
+
+        Operation             _queue[queue_depth];
+        std::atomic<uint8_t>  _queue_read{0};   // only changed by the state machine
+        std::atomic<uint8_t>  _queue_write{0};  // only changed by queueing functions
+        std::atomic<bool>     _busy{false};
+
+        volatile State _state = State::Idle;
+        uint32_t       _op_position = 0;    // offset into the current operation
+        uint16_t       _chunk_length = 0;   // length of the current page program
+        CacheLine     *_filling_line = nullptr;
+        uint32_t       _poll_due = 0;       // SysTick value to send the next READ STATUS at
+
+        SPIFlash(device_t &&device) : _device{std::move(device)} {
+            _message.message_done_callback = [&]() { this->_messageDone(); };
+        };
+
+        // prevent copying, the message callback captures this
+        SPIFlash(const SPIFlash &) = delete;
+
+        bool isIdle() const { return !_busy.load(); };
+
+        bool queueFull() const { return ((_queue_write.load() - _queue_read.load()) & 0xFF) >= queue_depth; };
+
+        // Read length bytes into to. The read is queued behind any pending programs or erases.
+        // If the whole range is already cached and nothing is pending, the data is copied and
+        // done_callback is called before this returns.
+        bool read(const uint32_t address, uint8_t *to, const uint16_t length, std::function<void(void)> &&done_callback) {
+            if (isIdle() && _readFromCache(address, to, length)) {
+                if (done_callback) { done_callback(); }
+                return true;
+            }
+            return _queueOperation(OperationType::Read, address, to, length, std::move(done_callback));
+        };
+
+        // Program length bytes from from (which must remain valid until done_callback).
+        // The target must already be erased.
+        bool program(const uint32_t address, const uint8_t *from, const uint16_t length, std::function<void(void)> &&done_callback) {
+            return _queueOperation(OperationType::Program, address, const_cast<uint8_t *>(from), length, std::move(done_callback));
+        };
+
+        bool eraseSector(const uint32_t address, std::function<void(void)> &&done_callback) {
+            return _queueOperation(OperationType::Erase4K, address, nullptr, 0, std::move(done_callback));
+        };
+
+        bool eraseBlock(const uint32_t address, std::function<void(void)> &&done_callback) {
+            return _queueOperation(OperationType::Erase64K, address, nullptr, 0, std::move(done_callback));
+        };
+
+        void invalidateCache() {
+            for (auto &line : _lines) { line.valid = false; }
+        };
+
+        // Send the next READ STATUS if one is due. Call once per tick, from only one context.
+        void update() {
+            if ((_state != State::PollWait) || ((int32_t)(SysTickTimer.getValue() - _poll_due) < 0)) {
+                return;
+            }
+            _sendPollStatus();
+        };
+
+#pragma mark Internals
+
+        bool _queueOperation(OperationType type, const uint32_t address, uint8_t *buffer, const uint16_t length, std::function<void(void)> &&done_callback) {
+            if (queueFull()) { return false; }
+
+            Operation &op    = _queue[_queue_write.load() & (queue_depth - 1)];
+            op.type          = type;
+            op.address       = address;
+            op.read_to       = buffer;
+            op.length        = length;
+            op.done_callback = std::move(done_callback);
+            _queue_write.fetch_add(1);
+
+            if (!_busy.exchange(true)) {
+                _startOperation();
+            }
+            return true;
+        };
+
+        CacheLine *_findLine(const uint32_t line_address) {
+            for (auto &line : _lines) {
+                if (line.valid && (line.address == line_address)) {
+                    line.last_use = ++_use_counter;
+                    return &line;
+                }
+            }
+            return nullptr;
+        };
+
+        CacheLine *_leastRecentlyUsedLine() {
+            CacheLine *lru = &_lines[0];
+            for (auto &line : _lines) {
+                if (!line.valid) { return &line; }
+                if ((int32_t)(line.last_use - lru->last_use) < 0) { lru = &line; }
+            }
+            return lru;
+        };
+
+        // returns true only if the whole range was in the cache
+        bool _readFromCache(uint32_t address, uint8_t *to, uint16_t length) {
+            while (length) {
+                CacheLine *line = _findLine(address & kCacheLineMask);
+                if (!line) { return false; }
+
+                uint16_t offset = address & (cache_line_size - 1);
+                uint16_t count  = std::min<uint16_t>(length, cache_line_size - offset);
+                memcpy(to, line->data() + offset, count);
+                address += count;
+                to      += count;
+                length  -= count;
+            }
+            return true;
+        };
+
+        void _invalidateRange(const uint32_t address, const uint32_t length) {
+            for (auto &line : _lines) {
+                if (line.valid && (line.address < address + length) && (address < line.address + cache_line_size)) {
+                    line.valid = false;
+                }
+            }
+        };
+
+        void _fillAddress(uint8_t *header, const uint8_t command, const uint32_t address) {
+            header[0] = command;
+            header[1] = (address >> 16) & 0xFF;
+            header[2] = (address >> 8) & 0xFF;
+            header[3] = (address >> 0) & 0xFF;
+        };
+
+        void _send(uint8_t *buffer, const uint16_t size) {
+            _message.setup(buffer, buffer, size, SPIMessage::DeassertAfter, SPIMessage::EndTransaction);
+            _device.queueMessage(&_message);
+        };
+
+        void _sendWriteEnable() {
+            _state      = State::WriteEnable;
+            _scratch[0] = kWriteEnable;
+            _send(_scratch, 1);
+        };
+
+        void _sendPollStatus() {
+            _state      = State::PollStatus;
+            _scratch[0] = kReadStatus1;
+            _scratch[1] = 0;
+            _send(_scratch, 2);
+        };
+
+        // Leave the bus alone until update() sends the next poll, at least one tick from now.
+        void _waitToPollStatus() {
+            _poll_due = SysTickTimer.getValue() + 1;
+            _state    = State::PollWait;
+        };
+
+        // Start (or continue) the operation at the head of the queue.
+        // Called with _busy already set.
+        void _startOperation() {
+            while (true) {
+                if (_queue_read.load() == _queue_write.load()) {
+                    _state = State::Idle;
+                    _busy.store(false);
+
+                    // something may have been queued between the check and clearing _busy
+                    if ((_queue_read.load() == _queue_write.load()) || _busy.exchange(true)) {
+                        return;
+                    }
+                    continue;
+                }
+
+                Operation &op = _queue[_queue_read.load() & (queue_depth - 1)];
+
+                if (op.type == OperationType::Read) {
+                    // copy out everything that's cached, and fill the first line that isn't
+                    while (_op_position < op.length) {
+                        uint32_t address = op.address + _op_position;
+                        CacheLine *line  = _findLine(address & kCacheLineMask);
+                        if (!line) {
+                            _filling_line          = _leastRecentlyUsedLine();
+                            _filling_line->valid   = false;
+                            _filling_line->address = address & kCacheLineMask;
+                            _fillAddress(_filling_line->raw, kFastRead, _filling_line->address);
+                            _filling_line->raw[4] = 0;  // dummy
+
+                            _state = State::FillLine;
+                            _send(_filling_line->raw, sizeof(_filling_line->raw));
+                            return;
+                        }
+
+                        uint16_t offset = address & (cache_line_size - 1);
+                        uint16_t count  = std::min<uint16_t>(op.length - _op_position, cache_line_size - offset);
+                        memcpy(op.read_to + _op_position, line->data() + offset, count);
+                        _op_position += count;
+                    }
+
+                    _finishOperation(op);
+                    continue;
+                }
+
+                // programs and erases all start with a write enable
+                if ((op.type != OperationType::Program) || (_op_position < op.length)) {
+                    _sendWriteEnable();
+                    return;
+                }
+
+                _finishOperation(op);
+            }
+        };
+
+        void _finishOperation(Operation &op) {
+            auto callback = std::move(op.done_callback);
+            op.done_callback = nullptr;
+            _op_position = 0;
+            _queue_read.fetch_add(1);
+
+            if (callback) { callback(); }
+        };
+
+        // Called from the SPI interrupt.
+        void _messageDone() {
+            Operation &op = _queue[_queue_read.load() & (queue_depth - 1)];
+
+            switch (_state) {
+                case State::FillLine:
+                    _filling_line->valid    = true;
+                    _filling_line->last_use = ++_use_counter;
+                    _filling_line           = nullptr;
+                    _startOperation();
+                    break;
+
+                case State::WriteEnable:
+                    if (op.type == OperationType::Program) {
+                        uint32_t address = op.address + _op_position;
+                        _chunk_length    = std::min<uint32_t>(op.length - _op_position, kPageSize - (address & (kPageSize - 1)));
+
+                        _fillAddress(_scratch, kPageProgram, address);
+                        memcpy(_scratch + kAddressHeader, op.program_from + _op_position, _chunk_length);
+                        _invalidateRange(address, _chunk_length);
+
+                        _state = State::Program;
+                        _send(_scratch, kAddressHeader + _chunk_length);
+                    } else {
+                        const bool is_4k = (op.type == OperationType::Erase4K);
+                        const uint32_t size = is_4k ? 4096 : 65536;
+                        const uint32_t address = op.address & ~(size - 1);
+
+                        _fillAddress(_scratch, is_4k ? kSectorErase4K : kBlockErase64K, address);
+                        _invalidateRange(address, size);
+
+                        _state = State::Erase;
+                        _send(_scratch, kAddressHeader);
+                    }
+                    break;
+
+                case State::Program:
+                    _op_position += _chunk_length;
+                    _waitToPollStatus();
+                    break;
+
+                case State::Erase:
+                    _waitToPollStatus();
+                    break;
+
+                case State::PollStatus:
+                    if (_scratch[1] & kStatusBusy) {
+                        _waitToPollStatus();
+                        break;
+                    }
+                    if (op.type != OperationType::Program) {
+                        _finishOperation(op);
+                    }
+                    _startOperation();
+                    break;
+
+                case State::PollWait:
+                case State::Idle:
+                    break;
+            }
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATESPIFLASH_H_ONCE */
@@ -48,13 +48,21 @@ const Motate::USBSettings_t Motate::USBSettings = {
     /*gPowerConsumption = */ 500
 };
 
-Motate::USBDevice< Motate::USBCDC > usb;
-//Motate::USBDevice< Motate::USBCDC, Motate::USBCDC > usb;
+// The number of independent virtual serial ports (CDC ACM functions) to present. More than one
+// makes a composite (IAD) device, so define this to 2 to also get Serial1. Each port uses three
+// endpoints and only endpoints 1-7 have DMA, so 2 is the most that will fit.
+#ifndef MOTATE_USB_SERIAL_PORTS
+#define MOTATE_USB_SERIAL_PORTS 1
+#endif
+
+Motate::USBRepeatedDevice< Motate::USBDeviceHardware, MOTATE_USB_SERIAL_PORTS, Motate::USBCDC > usb;
 
 namespace Motate {
 
     auto &Serial = usb.mixin<0>::Serial;
-//  auto &Serial1 = usb.mixin<1>::Serial;
+#if MOTATE_USB_SERIAL_PORTS > 1
+    auto &Serial1 = usb.mixin<1>::Serial;
+#endif
 
 } // namespace Motate
 
@@ -0,0 +1,242 @@
+/*
+  MotateSerialBridge.h - USB serial to UART bridge for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATESERIALBRIDGE_H_ONCE
+#define MOTATESERIALBRIDGE_H_ONCE
+
+#include <cinttypes>
+#include <algorithm> // for std::max
+#include "MotateServiceCall.h"
+#include "MotateUART.h"
+#include "MotateUSBCDC.h"
+
+/* SerialBridge connects a USBSerial and a UART, for USB-to-UART (or RS-485) adapters.
+ *
+ * Data is never copied by the CPU:
+ *  - USB -> UART: each OUT packet is received by DMA into one of out_packets packet buffers, which
+ *    is then handed to the UART with queueWrite(). The buffer is reused once the UART has sent it.
+ *    When all of them are waiting on the UART, no receive is started, so the USB NAKs the host.
+ *  - UART -> USB: the UART receives by DMA into a circular buffer of in_size bytes, and whatever
+ *    has arrived is sent from there to the host with queueWrite(). Space is only given back to the
+ *    UART once the host has it. When the buffer is full the UART's high-water mark deasserts RTS.
+ *
+ * UART receive transfers are kept to in_chunk bytes, so there's something to send every in_chunk
+ * bytes even if the line never goes idle. A pause of rx_idle_bit_times sends whatever is left.
+ *
+ * packet_size must be the bulk endpoint size (64 for full speed, 512 for high speed).
+ *
+ * The bridge takes the RX callbacks and the connection callback of the USBSerial, and the RX
+ * callbacks of the UART, so they can't be used with RXBuffer or TXBuffer at the same time. Writes
+ * queued by anything else on either side are sent as usual, in between the bridged data.
+ *
+ * All of the bookkeeping happens in handleServiceCallEvent(). The interrupts only call() it.
+ */
+
+namespace Motate {
+
+    template <typename usb_serial_t, typename uart_t, uint16_t packet_size = 64, uint8_t out_packets = 4,
+              uint16_t in_size = 512, uint16_t in_chunk = 64, uint8_t rx_idle_bit_times = 20>
+    struct SerialBridge : virtual ServiceCallEventHandler {
+        static_assert(out_packets > 1, "SerialBridge needs at least two OUT packet buffers.");
+        static_assert(((in_size-1)&in_size)==0, "SerialBridge in_size must be 2^N");
+        static_assert(in_chunk < in_size / 2, "SerialBridge in_chunk must be less than half of in_size");
+
+        usb_serial_t &_usb;
+        uart_t       &_uart;
+
+        ServiceCall bridge_manager;
+
+        // USB -> UART
+        struct OutPacket {
+            char      data[packet_size];
+            UARTWrite write;
+        };
+        OutPacket     _out[out_packets];
+        uint8_t       _out_receiving = 0;  // the packet the USB receives into next
+        uint8_t       _out_sending   = 0;  // the oldest packet handed to the UART
+        uint8_t       _out_count     = 0;  // packets handed to the UART and not done yet
+        bool          _out_rx_active = false;
+        volatile bool _out_rx_done   = false;
+
+        // UART -> USB
+        // Some DMA writes in whole words, past what was requested, so we have 4 bytes of padding (see RXBuffer).
+        char           _in_data[in_size + 4];
+        uint16_t       _in_read        = 0;  // the offset of the first byte the host doesn't have yet
+        uint16_t       _in_sending_end = 0;  // the offset after the end of _in_write
+        bool           _in_tx_active   = false;
+        volatile bool  _in_rx_requested = false;
+        USBSerialWrite _in_write;
+
+        // Number of bytes that went each way, to see that it's working.
+        uint32_t out_bytes = 0;
+        uint32_t in_bytes  = 0;
+
+        SerialBridge(usb_serial_t &usb_serial, uart_t &uart) : _usb{usb_serial}, _uart{uart} {};
+
+        // prevent copying, the callbacks capture this
+        SerialBridge(const SerialBridge&) = delete;
+
+        // WARNING!!
+        // This must be called later, outside of the constructors, to ensure that all dependencies are constructed.
+        // Call it after the UART's init().
+        void init() {
+            bridge_manager.setInterruptHandler(this);  // will call this->handleServiceCallEvent()
+            bridge_manager.setInterrupts(kInterruptPriorityLowest);
+
+            for (uint8_t i = 0; i < out_packets; i++) {
+                _out[i].write.done_callback = [&]() { bridge_manager.call(); };
+            }
+            _in_write.done_callback = [&]() { bridge_manager.call(); };
+
+            _usb.setRXTransferDoneCallback([&]() {
+                _out_rx_done = true;
+                bridge_manager.call();
+            });
+            _usb.setConnectionCallback([&](bool connected) { bridge_manager.call(); });
+
+            _uart.setRXTransferDoneCallback([&]() {
+                _in_rx_requested = false;
+                bridge_manager.call();
+            });
+            _uart.setRXIdleCallback(rx_idle_bit_times, [&]() { bridge_manager.call(); });
+
+            bridge_manager.call();
+        };
+
+        void handleServiceCallEvent() override {
+            _serviceOut();
+            _serviceIn();
+        };
+
+        // USB -> UART
+        void _serviceOut() {
+            if (_out_rx_done) {
+                _out_rx_done = false;
+                _out_rx_active = false;
+
+                // If the USB was disconnected, the position isn't in the packet, and nothing arrived
+                OutPacket &packet = _out[_out_receiving];
+                char *end = _usb.getRXTransferPosition();
+                if ((end > packet.data) && (end <= packet.data + packet_size)) {
+                    const uint16_t length = end - packet.data;
+                    out_bytes += length;
+                    _out_receiving = (_out_receiving + 1) % out_packets;
+                    _out_count++;
+                    _uart.queueWrite(packet.write.setup(reinterpret_cast<const uint8_t *>(packet.data), length));
+                }
+            }
+
+            // the UART sends them in order
+            while (_out_count && _out[_out_sending].write.done) {
+                _out_sending = (_out_sending + 1) % out_packets;
+                _out_count--;
+            }
+
+            // if all of the packets are waiting on the UART, the USB NAKs until one is free
+            if (!_out_rx_active && (_out_count < out_packets)) {
+                _out_rx_active = _usb.startRXPacketTransfer(_out[_out_receiving].data, packet_size);
+            }
+        };
+
+        uint16_t _inWriteOffset() {
+            char *pos = _uart.getRXTransferPosition();
+            if ((pos < _in_data) || (pos > _in_data + in_size)) {
+                return _in_read; // nothing has been started yet
+            }
+            return (pos - _in_data) & (in_size-1); // if it's one past the end, we want it to become zero
+        };
+
+        // UART -> USB
+        void _serviceIn() {
+            if (_in_tx_active && _in_write.done) {
+                _in_tx_active = false;
+                _in_read = _in_sending_end;
+            }
+
+            const uint16_t write_offset = _inWriteOffset();
+
+            // send what's arrived, up to the end of the buffer if it wrapped
+            if (!_in_tx_active && (write_offset != _in_read)) {
+                const uint16_t end = (write_offset > _in_read) ? write_offset : in_size;
+                _in_sending_end = end & (in_size-1);
+                _in_tx_active = true;
+                in_bytes += end - _in_read;
+                _usb.queueWrite(_in_write.setup(reinterpret_cast<const uint8_t *>(_in_data + _in_read), end - _in_read));
+            }
+
+            _restartIn(write_offset);
+        };
+
+        // This is RXBuffer::_restartTransfer(), using _in_read as the read position, and keeping the
+        // transfers to in_chunk bytes (plus the UART's high-water region).
+        void _restartIn(const uint16_t write_offset) {
+            if (_in_rx_requested) {
+                return;
+            }
+
+            // full
+            if (((write_offset + 1) & (in_size-1)) == _in_read) {
+                return;
+            }
+
+            char *write_pos = _in_data + write_offset;
+            char *write_pos_extra = _in_data;
+            int16_t transfer_size = 0;
+            int16_t transfer_size_extra = 0;
+
+            if (_in_read > write_offset) {
+                transfer_size = (_in_read - write_offset) - 4;
+                if (transfer_size < 1) {
+                    return;
+                }
+            } else if (_in_read == 0) {
+                transfer_size = (in_size - write_offset) - 1;
+            } else {
+                transfer_size = (in_size - write_offset);
+                transfer_size_extra = std::max(0, _in_read - 4);
+            }
+
+            const int16_t chunk = in_chunk + _uart.highWaterChars;
+            if (transfer_size > chunk) {
+                transfer_size = chunk;
+                transfer_size_extra = 0;
+            }
+
+            // When there isn't room for more than the high-water region, the UART won't start, and
+            // RTS stays deasserted until the host takes some and we try again.
+            _in_rx_requested = true;
+            if (!_uart.startRXTransfer(write_pos, transfer_size, write_pos_extra, transfer_size_extra)) {
+                _in_rx_requested = false;
+            }
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATESERIALBRIDGE_H_ONCE */
@@ -34,6 +34,7 @@
 #include <atomic>
 #include "MotateCommon.h"
 #include "MotateServiceCall.h"
+#include "MotateBusStats.h"
 
 
 /* After some setup, we call the processor-specific bits, then we have the
@@ -89,6 +90,11 @@ struct TWIInterruptHandler {
     virtual void handleTWIInterrupt(const TWIInterruptCause& interruptCause);
 };
 
+struct TWISlaveInterruptHandler {
+    // called from the interrupt when a master write to [start, start+length) of the register map ends
+    virtual void handleTWISlaveWrite(const uint16_t start, const uint16_t length){};
+};
+
 }  // namespace Motate
 
 #include <ProcessorTWI.h>
@@ -114,6 +120,13 @@ struct TWIBusDeviceBase {
     virtual void queueMessage(TWIMessage* msg){};
     // return a value that can be used by hardware to select this device
     virtual const TWIAddress& getAddress() const;
+    // called (from the interrupt) after a message from this device is done and its callback returned
+    virtual void messageDone(TWIMessage* msg, const bool success){};
+
+#if MOTATE_BUS_STATS == 1
+    // maintained by the Bus, see MotateBusStats.h
+    BusStats stats;
+#endif
 };
 
 // useful verbose enums
@@ -125,11 +138,19 @@ struct TWIMessage {
 
     enum class State { kIdle, kSetup, kSending, kDone };
 
-    enum class Direction { kTX, kRX };
+    enum class Direction {
+        kTX,
+        kRX,
+        kTXThenRX,  // Write command, then a repeated START and read into buffer, all as one transaction
+    };
 
     uint8_t* buffer = nullptr;
     uint16_t size   = 0;
 
+    // Only used for Direction::kTXThenRX
+    uint8_t* command      = nullptr;
+    uint16_t command_size = 0;
+
     TWIBusDeviceBase*        device                = nullptr;
     std::atomic<TWIMessage*> next_message          = nullptr;
     Instruction              instruction           = Instruction::kNormal;
@@ -140,6 +161,11 @@ struct TWIMessage {
     std::function<void(bool)> message_done_callback;
     std::atomic<State>        state = State::kIdle;
 
+#if MOTATE_BUS_STATS == 1
+    uint32_t _stats_queued_at  = 0;
+    uint32_t _stats_started_at = 0;
+#endif
+
     TWIMessage(){};
 
     void setup(uint8_t*                   new_buffer,
@@ -163,8 +189,25 @@ struct TWIMessage {
 
         internal_address = std::move(new_ia);
 
+        command      = nullptr;
+        command_size = 0;
+
         state = State::kSetup;
     }
+
+    // Setup a write of new_command followed by a repeated START and a read into new_buffer,
+    // with one message_done_callback for the whole thing. This replaces two messages chained
+    // with Instruction::kWithoutStop, and new_command may be longer than a TWIInternalAddress.
+    void setupWriteThenRead(uint8_t*          new_command,
+                            const uint16_t    new_command_size,
+                            uint8_t*          new_buffer,
+                            const uint16_t    new_size,
+                            TWIMessage* const new_next_message = nullptr) {
+        setup(new_buffer, new_size, Direction::kTXThenRX, {}, Instruction::kNormal, new_next_message);
+
+        command      = new_command;
+        command_size = new_command_size;
+    }
 };
 
 #pragma mark TWIBus
@@ -193,7 +236,19 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
     ServiceCall message_manager;
 
     TWIBusDeviceBase *_first_device, *_current_transaction_device;
-    std::atomic<TWIMessage*> _first_message, _last_message;
+    // The message queue is an intrusive multi-producer, single-consumer list:
+    //  - Any context (including ISRs) may queue, by atomically swapping _last_message
+    //    and then linking the old last message to the new one.
+    //  - Only handleTWIInterrupt() pops, from _first_message.
+    std::atomic<TWIMessage*> _first_message{nullptr}, _last_message{nullptr};
+
+    // Marks a message that was popped while a producer was between swapping _last_message
+    // and linking it. That producer then hands the popped message to handleServiceCallEvent()
+    // to be finished (see queueAndSendMessage()).
+    static TWIMessage* _detachedMarker() { return reinterpret_cast<TWIMessage*>(~uintptr_t{0}); }
+    bool _detached_message_success = false;
+    // There's never more than one, since the queue doesn't start again until it's finished.
+    std::atomic<TWIMessage*> _detached_message{nullptr};
 
     std::atomic<bool> sending = false;  // as long as this is true, sendNextMessage() does nothing
 
@@ -256,6 +311,10 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         hardware.setInterruptHandler(this); // will call this->handleTWIInterrupt(...)
         hardware.setInterrupts(kInterruptPriorityLow);  // enable interrupts and set the priority
         // hardware.enable();
+
+#if MOTATE_BUS_STATS == 1
+        BusStats::enableCycleCounter();
+#endif
     };
 
     // This function uses a ServiceCall to jump to the correct interrupt level, which may be higher or lower than the
@@ -266,6 +325,12 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
     }
 
     void handleServiceCallEvent() override {
+        // finish a detached message before anything after it is sent
+        auto detached_message = _detached_message.exchange(nullptr);
+        if (detached_message != nullptr) {
+            _finishMessage(detached_message, _detached_message_success);
+        }
+
         if (sending.load()) {
             return;
         }
@@ -289,8 +354,18 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
         first_message->state        = TWIMessage::State::kSending;
         _current_transaction_device = first_message->device;
         hardware.setAddress(_current_transaction_device->getAddress(), first_message->internal_address);
-        if (!hardware.startTransfer(first_message->buffer, first_message->size,
-                                    first_message->direction == TWIMessage::Direction::kRX)) {
+#if MOTATE_BUS_STATS == 1
+        first_message->_stats_started_at = BusStats::now();
+#endif
+        bool started;
+        if (first_message->direction == TWIMessage::Direction::kTXThenRX) {
+            started = hardware.startWriteThenReadTransfer(first_message->command, first_message->command_size,
+                                                          first_message->buffer, first_message->size);
+        } else {
+            started = hardware.startTransfer(first_message->buffer, first_message->size,
+                                             first_message->direction == TWIMessage::Direction::kRX);
+        }
+        if (!started) {
             __asm__("BKPT");  // about to send non-Setup message
         }
     }
@@ -322,69 +397,104 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
             return;
         }
 #endif
-        // Update the state
-        this_message->state.store(TWIMessage::State::kDone);
+        const bool success = !(interruptCause.isNACK() || interruptCause.isRxError() || interruptCause.isTxError());
+
+#if MOTATE_BUS_STATS == 1
+        // before the pop, since after that a producer may finish (and re-queue) this_message
+        if (this_message->device) {
+            this_message->device->stats.record(this_message->_stats_queued_at, this_message->_stats_started_at,
+                                               BusStats::now(), this_message->size + this_message->command_size,
+                                               interruptCause.isNACK(),
+                                               interruptCause.isRxError() || interruptCause.isTxError());
+        }
+#endif
 
         // IMPORTANT NOTE: the callback may call sendNextMessage(), so we
         //   keep sending at true to prevent issues.
 
         // Pop _first_message off
+        auto next_message = this_message->next_message.load();
+        if (next_message != nullptr) {
+            _first_message.store(next_message);
+        } else {
+            // These have to be set first, since a higher priority producer may take over as soon as
+            // the queue looks empty (or this_message is marked detached).
+            _first_message.store(nullptr);
+            _detached_message_success = success;
+
+            // If this is still the last message, the queue is now empty.
+            TWIMessage* expected_last = this_message;
+            if (!_last_message.compare_exchange_strong(expected_last, nullptr)) {
+                // Otherwise a producer swapped _last_message and is linking to this_message.
+                // We swap in the marker, so if it hasn't linked yet it'll know to finish this_message
+                // and set _first_message itself.
+                // (We only mark after the CAS fails, since this_message can't be finished and
+                // re-queued until we've done so.)
+                next_message = this_message->next_message.exchange(_detachedMarker());
+                if (next_message == nullptr) {
+                    sending.store(false);
+                    return;
+                }
+                _first_message.store(next_message);
+            }
+        }
 
-        // // Atomically set the new _first_message to the next message (may be nullptr)
-        // _first_message.store(this_message->next_message.load());
+        _finishMessage(this_message, success);
 
-        // Use Compare-And-Store (CAS) to atomically change _first_message safely
-        while(!_first_message.compare_exchange_weak(this_message, this_message->next_message)) {
-            __asm__("BKPT");  // missed the set!
-        }
+        sending.store(false);  // we can now allow more sending
 
-        // Use Compare-And-Store (CAS) to atomically change _last_message safely
-        // This will ONLY change _last_message IF _last_message==this_message.
-        // If it fails, this_message will be set to the value found at _last_message,
-        // so be careful to either not use this_message anymore or know it may have changed!
-        // _last_message.compare_exchange_weak(this_message, this_message->next_message);
+        sendNextMessage();
+    };
 
+    void _finishMessage(TWIMessage* this_message, const bool success) {
         this_message->next_message.store(nullptr);
 
+        // Update the state
+        this_message->state.store(TWIMessage::State::kDone);
+
         if (this_message->message_done_callback) {
-            this_message->message_done_callback(
-                !(interruptCause.isNACK() || interruptCause.isRxError() || interruptCause.isTxError()));
+            this_message->message_done_callback(success);
         } else {
             __asm__("BKPT");  // no callback!?
         }
 
-        sending.store(false);  // we can now allow more sending
-
-        sendNextMessage();
-    };
+        if (this_message->device) {
+            this_message->device->messageDone(this_message, success);
+        }
+    }
 
+    // Safe to call from any context, including interrupts, and takes the same time no matter
+    // how many messages are queued.
+    // new_message may already be linked to more messages (via setup()), and they're queued together.
+    // message_done_callback (and the device's messageDone()) are called from the TWI interrupt, or
+    // from the bus's ServiceCall (at kInterruptPriorityLowest), never from the caller's context.
     void queueAndSendMessage(TWIMessage* new_message) {
-        // TWIMessage* old_last_message = _last_message.load();
-
-        // // the result of this next line is that:
-        // // 1- _last_message is set to new_message
-        // // 2- old_last_message is set to the previous value of _last_message
-        // while(!_last_message.compare_exchange_weak(old_last_message, new_message)) { ; }
-
-        // // now we can safely set this:
-        // old_last_message->next_message = new_message;
-
-        // // And to carefully set _first_message, we'll store a temporary nullptr
-        // TWIMessage* null_temp = nullptr;
-        // // Then, IF _first_message matches nullptr, it'll set it to the new_message
-        // _first_message.compare_exchange_weak(null_temp, new_message);
-
-        TWIMessage* message_walker = _first_message.load();
-
-        // If _first_message != nullptr or we can't set it to new_message...
-        if (message_walker != nullptr ||
-            !_first_message.compare_exchange_weak(message_walker, new_message)) {
-            TWIMessage* next_message = message_walker;
-            while (next_message) {
-                message_walker = next_message;
-                next_message   = message_walker->next_message.load();
-            }
-            message_walker->next_message.store(new_message);
+        TWIMessage* new_last_message = new_message;
+        TWIMessage* chained_message  = new_last_message->next_message.load();
+#if MOTATE_BUS_STATS == 1
+        const uint32_t queued_at = BusStats::now();
+        new_last_message->_stats_queued_at = queued_at;
+#endif
+        while (chained_message != nullptr) {
+#if MOTATE_BUS_STATS == 1
+            chained_message->_stats_queued_at = queued_at;
+#endif
+            new_last_message = chained_message;
+            chained_message  = new_last_message->next_message.load();
+        }
+
+        // After this, new_last_message is the end of the queue, and nothing else can link to old_last_message.
+        TWIMessage* old_last_message = _last_message.exchange(new_last_message);
+
+        if (old_last_message == nullptr) {
+            // the queue was empty, and the consumer won't touch _first_message until it's set
+            _first_message.store(new_message);
+        } else if (old_last_message->next_message.exchange(new_message) == _detachedMarker()) {
+            // old_last_message was sent and popped (by the interrupt) before we could link to it,
+            // so it's up to us to have it finished, then start the queue over from new_message.
+            // It's finished by handleServiceCallEvent(), so callbacks don't run in our context.
+            _detached_message.store(old_last_message);
+            _first_message.store(new_message);
         }
 
         sendNextMessage();
@@ -437,5 +547,89 @@ struct TWIBus : virtual TWIInterruptHandler, virtual ServiceCallEventHandler {
     constexpr TWIBusDevice getDevice(const TWIAddress&& address) { return {this, std::move(address)}; }
 };  // TWIBus
 
+
+#pragma mark TWISlave
+/**************************************************
+ *
+ * TWI Slave, serving a register map to an I2C master
+ *
+ * The master sets the register pointer with the first byte of a write, then reads or writes
+ * from there. Reads and writes go by DMA directly to the registers, so the master can run at
+ * full speed. Write callbacks can be registered for ranges of the map, and are called (from the
+ * interrupt) after a write that touched the range ends.
+ *
+ * Registers may be changed by the application at any time, but a multi-byte value that changes
+ * while the master is reading it may be seen torn.
+ *
+ **************************************************/
+
+template <pin_number twiSCKPinNumber, pin_number twiSDAPinNumber, uint16_t register_count, uint8_t max_write_callbacks = 8>
+struct TWISlave : virtual TWISlaveInterruptHandler {
+    static_assert(IsTWISCKPin<twiSCKPinNumber>(), "TWI SCK Pin is not on a hardware TWI.");
+
+    static_assert(IsTWISDAPin<twiSDAPinNumber>(), "TWI SDA Pin is not on a hardware TWI.");
+
+    static_assert((TWISCKPin<twiSCKPinNumber>::twiNum == TWISDAPin<twiSDAPinNumber>::twiNum),
+                  "TWI SCK and SDA pins are not all on the same TWI hardware peripheral.");
+
+    static_assert(register_count > 0 && register_count <= 256, "TWISlave register map must be 1 to 256 bytes.");
+
+    TWISCKPin<twiSCKPinNumber> sckPin{};
+    TWISDAPin<twiSDAPinNumber> sdaPin{};
+
+    TWISlaveGetHardware<twiSCKPinNumber, twiSDAPinNumber> hardware;
+
+    // DMA works in whole words on some parts, so keep this aligned and padded (see SamTWI.h)
+    alignas(4) uint8_t registers[(register_count + 3) & ~3];
+
+    struct WriteCallback {
+        uint16_t                                start  = 0;
+        uint16_t                                length = 0;
+        std::function<void(uint16_t, uint16_t)> callback;
+    };
+
+    WriteCallback _write_callbacks[max_write_callbacks];
+    uint8_t       _write_callback_count = 0;
+
+    TWISlave() : hardware{} {}
+
+    // prevent copying, the hardware holds a pointer to this
+    TWISlave(const TWISlave&) = delete;
+
+    // WARNING!!
+    // This must be called later, outside of the constructors, to ensure that all dependencies are constructed.
+    void init(const uint8_t address) {
+        hardware.setInterruptHandler(this);  // will call this->handleTWISlaveWrite(...)
+        hardware.init(address, registers, register_count);
+    }
+
+    // Call callback(start, length) after a master write ends that touched [start, start+length).
+    // The parameters passed are the part of the write that overlaps the range.
+    bool addWriteCallback(const uint16_t start, const uint16_t length, std::function<void(uint16_t, uint16_t)>&& callback) {
+        if (_write_callback_count >= max_write_callbacks) {
+            return false;
+        }
+        auto& wc    = _write_callbacks[_write_callback_count];
+        wc.start    = start;
+        wc.length   = length;
+        wc.callback = std::move(callback);
+        _write_callback_count++;
+        return true;
+    }
+
+    void handleTWISlaveWrite(const uint16_t start, const uint16_t length) override {
+        const uint16_t end = start + length;
+        for (uint8_t i = 0; i < _write_callback_count; i++) {
+            auto&          wc     = _write_callbacks[i];
+            const uint16_t wc_end = wc.start + wc.length;
+            if ((start < wc_end) && (wc.start < end)) {
+                const uint16_t overlap_start = (start > wc.start) ? start : wc.start;
+                const uint16_t overlap_end   = (end < wc_end) ? end : wc_end;
+                wc.callback(overlap_start, overlap_end - overlap_start);
+            }
+        }
+    }
+};  // TWISlave
+
 }  // namespace Motate
 #endif /* end of include guard: MOTATETWI_H_ONCE */
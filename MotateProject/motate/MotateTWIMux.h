@@ -0,0 +1,282 @@
+/*
+  MotateTWIMux.h - I2C multiplexer support for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATETWIMUX_H_ONCE
+#define MOTATETWIMUX_H_ONCE
+
+#include <cinttypes>
+#include <atomic>
+#include "MotateTWI.h"
+
+/* TWIMux routes messages for devices behind a TCA9548-style I2C multiplexer on a TWIBus.
+ *
+ * The mux itself is a device on the bus, and selects downstream channels with a one-byte write
+ * of a channel bitmask. Devices are made with mux.getDevice(channel, address), and are used just
+ * like a TWIBus::Device_t, so several devices may share an address on different channels.
+ *
+ * Messages from the mux's devices are held by the mux, and passed to the bus one at a time:
+ *  - A channel select is only sent when the channel is different from the last one selected.
+ *    The message is queued to the bus once the select is done. If the select fails, the message
+ *    fails too (its message_done_callback gets false), rather than going to whatever channel was
+ *    selected before.
+ *  - Up to fairness_window messages for the selected channel are sent before moving on, even if
+ *    they were queued after messages for other channels. Channels are then served round-robin.
+ *
+ * Messages for other devices on the bus are not held, and are sent in between as usual.
+ *
+ * Messages queued to a mux device must not be chained with next_message. Use setupWriteThenRead()
+ * for register reads.
+ */
+
+namespace Motate {
+
+    template <typename bus_t, uint8_t channel_count = 8, uint8_t fairness_window = 4>
+    struct TWIMux : virtual ServiceCallEventHandler {
+        static_assert(channel_count > 0 && channel_count <= 8, "TWIMux supports 1 to 8 channels.");
+        static_assert(fairness_window > 0, "TWIMux fairness_window must be at least 1.");
+
+        using mux_type = TWIMux<bus_t, channel_count, fairness_window>;
+
+        static constexpr int8_t kNoChannel = -1;
+
+#pragma mark TWIMuxDevice (inside TWIMux)
+        /**************************************************
+         *
+         * TWI Mux Device, a device on one channel of a TWIMux.
+         *
+         **************************************************/
+
+        struct TWIMuxDevice : TWIBusDeviceBase {
+            mux_type* const _mux;
+            const uint8_t   _channel;
+
+            TWIAddress _twi_address;  // the address of this device, on its channel
+
+            constexpr TWIMuxDevice(mux_type* const parent_mux, const uint8_t channel, const TWIAddress&& address)
+                : _mux{parent_mux}, _channel{channel}, _twi_address{std::move(address)} {};
+
+            // prevent copying or deleting
+            TWIMuxDevice(const TWIMuxDevice&) = delete;
+            TWIMuxDevice(TWIMuxDevice&& other) = delete;
+
+            // queue message
+            void queueMessage(TWIMessage* msg) override {
+                msg->device = this;
+                _mux->queueMessageFromDevice(msg);
+            };
+
+            void messageDone(TWIMessage* msg, const bool success) override { _mux->_messageDone(msg); };
+
+            const TWIAddress& getAddress() const override { return _twi_address; };
+
+            uint8_t getChannel() const { return _channel; };
+
+            mux_type* const getMux() const { return _mux; };
+        };
+
+        using Device_t = TWIMuxDevice;
+
+        bus_t* const                 _bus;
+        typename bus_t::Device_t     _mux_device;  // the mux chip itself
+
+        ServiceCall message_manager;
+
+        // Queued messages are pushed here by any context, then sorted into the channel queues
+        // by handleServiceCallEvent(), which is the only one that touches the channel queues.
+        std::atomic<TWIMessage*> _incoming{nullptr};
+        TWIMessage*              _channel_first[channel_count] = {};
+        TWIMessage*              _channel_last[channel_count]  = {};
+
+        std::atomic<TWIMessage*> _in_flight{nullptr};
+
+        int8_t  _selected_channel = kNoChannel;  // what the mux is set to, as far as we know
+        uint8_t _current_channel  = 0;           // the channel being served
+        uint8_t _burst_count      = 0;           // messages sent for _current_channel in a row
+
+        TWIMessage  _select_message;
+        uint8_t     _select_value;
+        TWIMessage* _after_select = nullptr;  // the message to send once the select is done
+
+        // Number of channel selects sent and skipped, to see how well grouping is working.
+        uint32_t select_count  = 0;
+        uint32_t skipped_count = 0;
+
+        TWIMux(bus_t* const bus, const TWIAddress&& address)
+            : _bus{bus}, _mux_device{bus, std::move(address)} {
+            _select_message.message_done_callback = [&](bool worked) {
+                TWIMessage* msg = _after_select;
+                _after_select   = nullptr;
+                if (worked) {
+                    _bus->queueAndSendMessage(msg);
+                    return;
+                }
+                // we don't know what the mux is set to now, and msg can't go out on this channel
+                _selected_channel = kNoChannel;
+                _failMessage(msg);
+            };
+        };
+
+        // prevent copying, the message callbacks capture this
+        TWIMux(const TWIMux&) = delete;
+
+        // WARNING!!
+        // This must be called later, outside of the constructors, to ensure that all dependencies are constructed.
+        // Call it after the bus's init().
+        void init() {
+            message_manager.setInterruptHandler(this);  // will call this->handleServiceCallEvent()
+            message_manager.setInterrupts(kInterruptPriorityLowest);
+        };
+
+        // TWIMuxDevice factory on TWIMux
+        constexpr TWIMuxDevice getDevice(const uint8_t channel, const TWIAddress&& address) {
+            return {this, channel, std::move(address)};
+        }
+
+        // DO NOT DIRECT CALL THIS - call device->queueMessage instead!
+        // Safe to call from any context, including interrupts.
+        void queueMessageFromDevice(TWIMessage* msg) {
+#ifdef IN_DEBUGGER
+            if (msg->next_message.load() != nullptr) {
+                __asm__("BKPT");  // chained messages can't go through the mux
+            }
+#endif
+            TWIMessage* head = _incoming.load();
+            do {
+                msg->next_message.store(head);
+            } while (!_incoming.compare_exchange_weak(head, msg));
+
+            message_manager.call();
+        };
+
+        // Forget which channel is selected, so the next message sends a select.
+        // Call this if something else may have changed the mux.
+        void invalidateSelection() { _selected_channel = kNoChannel; };
+
+        void handleServiceCallEvent() override {
+            _sortIncoming();
+
+            if (_in_flight.load() != nullptr) {
+                return;
+            }
+
+            int8_t channel = _pickChannel();
+            if (channel == kNoChannel) {
+                return;
+            }
+
+            TWIMessage* msg = _channel_first[channel];
+            _channel_first[channel] = msg->next_message.load();
+            if (_channel_first[channel] == nullptr) {
+                _channel_last[channel] = nullptr;
+            }
+            msg->next_message.store(nullptr);
+
+            _in_flight.store(msg);
+
+            if (channel != _selected_channel) {
+                _selected_channel = channel;
+                _select_value     = 1 << channel;
+                _after_select     = msg;
+                _select_message.setup(&_select_value, 1, TWIMessage::Direction::kTX, {}, TWIMessage::Instruction::kNormal);
+                select_count++;
+                _mux_device.queueMessage(&_select_message);
+            } else {
+                skipped_count++;
+                _bus->queueAndSendMessage(msg);
+            }
+        };
+
+        // Move everything from _incoming to the end of its channel queue, in the order it was queued.
+        void _sortIncoming() {
+            TWIMessage* reversed = _incoming.exchange(nullptr);
+            TWIMessage* walker   = nullptr;
+            while (reversed != nullptr) {
+                TWIMessage* next = reversed->next_message.load();
+                reversed->next_message.store(walker);
+                walker   = reversed;
+                reversed = next;
+            }
+
+            while (walker != nullptr) {
+                TWIMessage* next    = walker->next_message.load();
+                const uint8_t channel = static_cast<TWIMuxDevice*>(walker->device)->getChannel();
+
+                walker->next_message.store(nullptr);
+                if (_channel_last[channel] == nullptr) {
+                    _channel_first[channel] = walker;
+                } else {
+                    _channel_last[channel]->next_message.store(walker);
+                }
+                _channel_last[channel] = walker;
+
+                walker = next;
+            }
+        };
+
+        // Stay on the current channel until its window is used up, then round-robin.
+        int8_t _pickChannel() {
+            if ((_burst_count < fairness_window) && (_channel_first[_current_channel] != nullptr)) {
+                _burst_count++;
+                return _current_channel;
+            }
+
+            for (uint8_t i = 1; i <= channel_count; i++) {
+                const uint8_t channel = (_current_channel + i) % channel_count;
+                if (_channel_first[channel] != nullptr) {
+                    _current_channel = channel;
+                    _burst_count     = 1;
+                    return channel;
+                }
+            }
+
+            return kNoChannel;
+        };
+
+        // Finish msg without sending it, the way the bus would if it failed.
+        // Called from the TWI interrupt (from the select's callback).
+        void _failMessage(TWIMessage* msg) {
+            msg->state.store(TWIMessage::State::kDone);
+            if (msg->message_done_callback) {
+                msg->message_done_callback(false);
+            }
+            msg->device->messageDone(msg, false);  // calls _messageDone()
+        };
+
+        // called from the TWI interrupt or the bus's ServiceCall, after the message's own callback
+        void _messageDone(TWIMessage* msg) {
+            if (_in_flight.load() == msg) {
+                _in_flight.store(nullptr);
+                message_manager.call();
+            }
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATETWIMUX_H_ONCE */
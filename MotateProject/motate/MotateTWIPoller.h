@@ -0,0 +1,217 @@
+/*
+  MotateTWIPoller.h - Periodic TWI read scheduler for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOTATETWIPOLLER_H_ONCE
+#define MOTATETWIPOLLER_H_ONCE
+
+#include <cinttypes>
+#include <cstring>
+#include <atomic>
+#include "MotateTWI.h"
+#include "MotateTimers.h"
+
+/* TWIPoller reads registers from devices on one TWIBus at fixed periods.
+ *
+ * Each job is a device, a register (command) of up to kMaxCommandSize bytes, a read length, and
+ * a period in SysTick ticks (ms). update() should be called at least once per tick, from a
+ * SysTickEvent or the main loop. All jobs that are due in the same update() are linked together
+ * and queued as one chain, so they go out back-to-back without waiting for each other's callbacks.
+ *
+ * Each job reads into one half of a caller-supplied buffer of 2*length bytes, alternating halves,
+ * so the last complete result is never being written. read() copies it out and uses a sequence
+ * count to make sure it didn't change during the copy.
+ *
+ * A job that comes due while its last read is still in flight is skipped and counted as an overrun.
+ */
+
+namespace Motate {
+
+    template <typename bus_t, uint8_t max_jobs = 16>
+    struct TWIPoller {
+        static constexpr uint8_t kMaxCommandSize = 4;
+
+        using device_t = typename bus_t::Device_t;
+
+        struct Stats {
+            uint32_t completed     = 0;
+            uint32_t errors        = 0;
+            uint32_t overruns      = 0;  // skipped because the last read was still in flight
+            uint32_t last_latency  = 0;  // ticks from when it was due to when it finished
+            uint32_t max_latency   = 0;
+            uint32_t last_finished = 0;  // tick of the last successful read
+        };
+
+        struct Job {
+            device_t  *device  = nullptr;
+            uint8_t   *buffer  = nullptr;  // 2 * length bytes, double buffered
+            uint16_t   length  = 0;
+            uint32_t   period  = 0;
+            uint32_t   next_due = 0;
+            uint32_t   started_due = 0;  // the due time of the read in flight
+
+            uint8_t    command[kMaxCommandSize];
+            uint8_t    command_size = 0;
+
+            TWIMessage message;
+
+            std::atomic<bool>     in_flight{false};
+            std::atomic<uint8_t>  ready_half{0};  // the half that holds the last complete result
+            std::atomic<uint32_t> sequence{0};    // incremented for every complete result
+
+            Stats stats;
+        };
+
+        bus_t * const _bus;
+        Job           _jobs[max_jobs];
+        uint8_t       _job_count = 0;
+
+        TWIPoller(bus_t *bus) : _bus{bus} {};
+
+        // prevent copying, the message callbacks capture this
+        TWIPoller(const TWIPoller &) = delete;
+
+        // Add a job. buffer must be 2*length bytes, and stay valid.
+        // Returns the job number, or -1 if there's no room or the command is too long.
+        int8_t addJob(device_t *device, const uint8_t *command, const uint8_t command_size, uint8_t *buffer,
+                      const uint16_t length, const uint32_t period) {
+            if ((_job_count >= max_jobs) || (command_size > kMaxCommandSize) || (length == 0) || (period == 0)) {
+                return -1;
+            }
+
+            const uint8_t job_num = _job_count;
+            Job &job = _jobs[job_num];
+
+            job.device       = device;
+            job.buffer       = buffer;
+            job.length       = length;
+            job.period       = period;
+            job.next_due     = SysTickTimer.getValue();
+            job.command_size = command_size;
+            std::memcpy(job.command, command, command_size);
+
+            job.message.message_done_callback = [&, job_num](bool worked) { this->_jobDone(job_num, worked); };
+
+            // only make it visible to update() once it's complete
+            _job_count = job_num + 1;
+            return job_num;
+        };
+
+        // Start every job that's due. Safe to call from a SysTickEvent.
+        void update() {
+            const uint32_t now = SysTickTimer.getValue();
+
+            TWIMessage *first_message = nullptr;
+            TWIMessage *last_message  = nullptr;
+
+            for (uint8_t i = 0; i < _job_count; i++) {
+                Job &job = _jobs[i];
+
+                if ((int32_t)(now - job.next_due) < 0) {
+                    continue;
+                }
+
+                // step forward by whole periods, so a late job doesn't try to catch up
+                const uint32_t due = job.next_due;
+                job.next_due += ((now - due) / job.period + 1) * job.period;
+
+                if (job.in_flight.exchange(true)) {
+                    job.stats.overruns++;
+                    continue;
+                }
+                job.started_due = due;
+
+                uint8_t *target = job.buffer + ((job.ready_half.load() ^ 1) * job.length);
+                job.message.setupWriteThenRead(job.command, job.command_size, target, job.length);
+                job.message.device = job.device;
+
+                if (last_message) {
+                    last_message->next_message = &job.message;
+                } else {
+                    first_message = &job.message;
+                }
+                last_message = &job.message;
+            }
+
+            if (first_message) {
+                _bus->queueAndSendMessage(first_message);
+            }
+        };
+
+        // Copy the last complete result for job_num into out (length bytes).
+        // Returns false if there's no result yet.
+        bool read(const uint8_t job_num, uint8_t *out) const {
+            if (job_num >= _job_count) {
+                return false;
+            }
+            const Job &job = _jobs[job_num];
+
+            uint32_t sequence;
+            do {
+                sequence = job.sequence.load();
+                if (sequence == 0) {
+                    return false;
+                }
+                std::memcpy(out, job.buffer + (job.ready_half.load() * job.length), job.length);
+            } while (sequence != job.sequence.load());
+
+            return true;
+        };
+
+        const Stats &getStats(const uint8_t job_num) const { return _jobs[job_num].stats; };
+
+        void resetStats(const uint8_t job_num) { _jobs[job_num].stats = Stats{}; };
+
+        // called from the TWI interrupt
+        void _jobDone(const uint8_t job_num, const bool worked) {
+            Job &job = _jobs[job_num];
+            const uint32_t now = SysTickTimer.getValue();
+
+            if (worked) {
+                // the half we just filled is now the one to read
+                job.ready_half.store(job.ready_half.load() ^ 1);
+                job.sequence.fetch_add(1);
+
+                job.stats.completed++;
+                job.stats.last_finished = now;
+            } else {
+                job.stats.errors++;
+            }
+
+            job.stats.last_latency = now - job.started_due;
+            if (job.stats.last_latency > job.stats.max_latency) {
+                job.stats.max_latency = job.stats.last_latency;
+            }
+
+            job.in_flight.store(false);
+        };
+    };
+
+} // namespace Motate
+
+#endif /* end of include guard: MOTATETWIPOLLER_H_ONCE */
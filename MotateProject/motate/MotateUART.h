@@ -29,11 +29,14 @@
 
 #include "MotatePins.h"
 #include "MotateCommon.h"
+#include "MotateReadiness.h"
 
 #ifndef MOTATEUART_H_ONCE
 #define MOTATEUART_H_ONCE
 
 #include <cinttypes>
+#include <functional>
+#include <atomic>
 
 /* After some setup, we call the processor-specific bits, then we have the
  * any-processor parts.
@@ -67,13 +70,40 @@ namespace Motate {
         static constexpr uint16_t RTSCTSFlowControl  = 1 << 5;
         static constexpr uint16_t XonXoffFlowControl = 1 << 6;
 
+        // RTS becomes the RS-485 driver enable, and is driven by the hardware
+        static constexpr uint16_t RS485              = 1 << 7;
+        // 9-bit multidrop addressing (in place of parity), see UART::setMultidropAddress()
+        static constexpr uint16_t Multidrop          = 1 << 8;
+
         // TODO: Add polarity inversion and bit reversal options
     };
 
     struct UARTInterrupt : Interrupt {
+        static constexpr uint16_t OnRxIdle          = 1<<9;
+
         /* These are for internal use only: */
         static constexpr uint16_t OnCTSChanged      = 1<<10;
     };
+
+    // A caller-owned block of data for UART::queueWrite(). The data is sent directly by DMA, without
+    // copying, so it (and this) must stay valid and unchanged until done is true.
+    struct UARTWrite {
+        const uint8_t *data = nullptr;
+        uint16_t length = 0;
+
+        std::function<void(void)> done_callback; // called from the interrupt once the data is sent, may be empty
+        volatile bool done = true;
+
+        UARTWrite *_next = nullptr; // maintained by the UART
+
+        UARTWrite *setup(const uint8_t *new_data, const uint16_t new_length) {
+            data = new_data;
+            length = new_length;
+            done = false;
+            _next = nullptr;
+            return this;
+        };
+    };
 } // namespace Motate
 
 #include <ProcessorUART.h>
@@ -104,13 +134,47 @@ namespace Motate {
         std::function<void(bool)> connection_state_changed_callback;
         std::function<void(void)> transfer_rx_done_callback;
         std::function<void(void)> transfer_tx_done_callback;
+        std::function<void(void)> rx_idle_callback;
+
+        // kReadable on RX transfer done or idle, kWritable on TX transfer done, kDone when a queued write is done.
+        // Watching kReadable turns on the RX time-out (where the hardware has one) if it isn't on already.
+        ReadinessSource readiness;
+
+        // Queued writes, urgent ones are sent before any normal ones that haven't started yet
+        UARTWrite *_first_write = nullptr;
+        UARTWrite *_last_write = nullptr;
+        UARTWrite *_first_urgent_write = nullptr;
+        UARTWrite *_last_urgent_write = nullptr;
+        UARTWrite * volatile _active_write = nullptr; // taken off its queue, and being sent
+
+        // Transfers from startTXTransfer() (the TXBuffer) share the TX DMA with queued writes. Only
+        // one of them is in the hardware at a time. A transfer asked for while a queued write is
+        // being sent is held here and started after it, so startTXTransfer() doesn't fail (and
+        // TXBuffer::_restartTransfer() doesn't spin) just because a queued write has the DMA.
+        volatile bool _tx_transfer_active = false;
+        char *_pending_tx_buffer = nullptr;
+        uint16_t _pending_tx_length = 0;
+        char *_tx_transfer_end = nullptr; // where the last transfer from startTXTransfer() ends
 
         uint8_t highWaterChars;
 
+        // XON/XOFF flow control (UARTMode::XonXoffFlowControl)
+        static constexpr uint32_t kXonXoffIdleBitTimes = 20; // so a lone XOFF is seen quickly
+        static constexpr uint32_t kReadableIdleBitTimes = 20; // so kReadable isn't only raised when the RX transfer fills
+        bool _xon_xoff = false;
+        bool _sent_xoff = false;       // we told the other side to stop
+        char *_rx_scanned = nullptr;   // received bytes before this have been checked for XON/XOFF
+        std::atomic<bool> _rx_scanning {false};
+
         UART(const uint32_t baud = 115200, const uint16_t options = UARTMode::As8N1, const uint8_t highWater=10) : ctsPin{kPullUp, [&]{this->uartInterruptHandler(UARTInterrupt::OnCTSChanged);}}, highWaterChars{highWater} {
             hardware.init();
-            // Auto-enable RTS/CTS if the pins are provided.
-            setOptions(baud, options | UARTMode::RTSCTSFlowControl, /*fromConstructor =*/ true);
+            // Auto-enable RTS/CTS if the pins are provided, unless we're using XON/XOFF or RTS is the RS-485 DE.
+            setOptions(baud, (options & (UARTMode::XonXoffFlowControl | UARTMode::RS485)) ? options : (options | UARTMode::RTSCTSFlowControl), /*fromConstructor =*/ true);
+            readiness.watched_callback = [&](const Readiness::Type events) {
+                if ((events & Readiness::kReadable) && !rx_idle_callback) {
+                    hardware.setRxIdleTimeout(_defaultRxIdleBitTimes());
+                }
+            };
         };
 
         // WARNING!!
@@ -131,8 +195,41 @@ namespace Motate {
 
         void setOptions(const uint32_t baud, const uint16_t options, const bool fromConstructor=false) {
             hardware.setOptions(baud, options, fromConstructor);
+
+            _xon_xoff = options & UARTMode::XonXoffFlowControl;
+            if (!rx_idle_callback) {
+                hardware.setRxIdleTimeout(_defaultRxIdleBitTimes());
+            }
         };
 
+        // The RX time-out to use when there's no rx_idle_callback
+        uint32_t _defaultRxIdleBitTimes() {
+            if (_xon_xoff) {
+                return kXonXoffIdleBitTimes;
+            }
+            return readiness.isWatched(Readiness::kReadable) ? kReadableIdleBitTimes : 0;
+        };
+
+        // Multidrop (with UARTMode::Multidrop): only frames sent to address (or broadcast_address,
+        // if it's not -1) are received, the rest are dropped by the hardware. -1 receives everything.
+        void setMultidropAddress(const int16_t address, const int16_t broadcast_address = -1) {
+            hardware.setMultidropAddress(address, broadcast_address);
+        };
+
+        // Select the node(s) the next bytes sent are for. Call before starting the frame's TX transfer.
+        void sendMultidropAddress(const uint8_t address) {
+            hardware.sendMultidropAddress(address);
+        };
+
+        // RS-485 (with UARTMode::RS485): extra bit periods to hold DE after each character
+        void setTurnaroundTime(const uint8_t bit_times) {
+            hardware.setTurnaroundTime(bit_times);
+        };
+
+        // The baud rate actually being used, and its error from the requested one in parts per million
+        uint32_t getBaud() const { return hardware.getBaud(); };
+        int32_t getBaudErrorPPM() const { return hardware.getBaudErrorPPM(); };
+
         bool isConnected() {
             // The cts pin allows to know if we're allowed to send,
             // which gives us a reasonable guess, at least.
@@ -149,12 +246,88 @@ namespace Motate {
             if (!isRealAndCorrectRTSPin<rtsPinNumber, rxPinNumber>()) {
                 rtsPin = false; // active low, so this means go
             }
+            if (_xon_xoff && _sent_xoff) {
+                _sent_xoff = false;
+                hardware.writeControlByte(kUARTXOn);
+            }
         };
 
         void _stopRX() {
             if (!isRealAndCorrectRTSPin<rtsPinNumber, rxPinNumber>()) {
                 rtsPin = true; // active low, so this means stop
             }
+            if (_xon_xoff && !_sent_xoff) {
+                _sent_xoff = true;
+                hardware.writeControlByte(kUARTXOff);
+            }
+        };
+
+        // Check newly received bytes for XON/XOFF, and pause or resume TX for them. Then strip them
+        // out by stopping the RX DMA, moving the bytes after them back, and restarting the DMA that
+        // many bytes back. This is called at the hand-off (getRXTransferPosition()), and from the RX
+        // idle and RX done interrupts. Bytes before _rx_scanned are clean.
+        // If the DMA moves on to a new region before the bytes at the end of the last one are
+        // stripped, those are acted on but stay in the stream.
+        void _scanRX() {
+            if (_rx_scanning.exchange(true)) {
+                return; // we interrupted a scan, which will see the same bytes
+            }
+
+            char *scan = _rx_scanned;
+            char *first_control = nullptr;
+            bool resumed = false;
+            while (true) {
+                char *position = hardware.getRXTransferPosition();
+                if (scan == nullptr || position < scan) {
+                    // a new region started somewhere else, we can only start over there
+                    scan = position;
+                    break;
+                }
+
+                for (; scan < position; scan++) {
+                    const char c = *scan;
+                    if (c == kUARTXOff) {
+                        hardware.pauseTX();
+                    } else if (c == kUARTXOn) {
+                        hardware.resumeTX();
+                        resumed = true;
+                    } else {
+                        continue;
+                    }
+                    if (first_control == nullptr) {
+                        first_control = scan;
+                    }
+                }
+
+                if (first_control == nullptr) {
+                    break;
+                }
+
+                if (!hardware.holdRXTransfer(scan)) {
+                    // more came in while we were looking, go around again
+                    continue;
+                }
+
+                char *out = first_control;
+                for (char *walker = first_control; walker < scan; walker++) {
+                    if ((*walker != kUARTXOff) && (*walker != kUARTXOn)) {
+                        *out++ = *walker;
+                    }
+                }
+                hardware.releaseRXTransfer(scan - out);
+                scan = out;
+                break;
+            }
+
+            _rx_scanned = scan;
+            _rx_scanning = false;
+
+            if (resumed) {
+                // resumeTX() started anything held while paused, this starts what's queued behind it
+                hardware.setInterruptTxTransferDone(false);
+                _startNextTransfer();
+                _resumeTxDoneInterrupt();
+            }
         };
 
         // WARNING: Currently only reads in bytes. For more-that-byte size data, we'll need another call.
@@ -253,6 +426,132 @@ namespace Motate {
         };
 
 
+        // Send write->data by DMA, after anything already sent or queued, without copying it.
+        // write->done is set and write->done_callback is called when it's been sent.
+        //
+        // Normal writes go after any transfers from startTXTransfer() (the TXBuffer), so they are
+        // sent after what was written to the TXBuffer before them. They only start once the
+        // TXBuffer has nothing left to send, so a TXBuffer that is kept full holds them back.
+        //
+        // If urgent is true, it's sent as soon as the current transfer is done, ahead of any normal
+        // queued writes and of the next transfer started from the TX done callback. Writes are never
+        // split, so an urgent write waits for at most one transfer.
+        //
+        // Sequence with an urgent write queued while the TXBuffer has data:
+        //   1. TXBuffer transfer A is being sent, urgent write U is queued
+        //   2. A is done: U is started, then the TX done callback asks for TXBuffer transfer B,
+        //      which is held (startTXTransfer() returns true)
+        //   3. U is done: B is started, and getTXTransferPosition() reported the end of A until then
+        //
+        // Call this from the main context or an interrupt of the same or lower priority as the UART.
+        bool queueWrite(UARTWrite *write, const bool urgent = false) {
+            if (write->length == 0) {
+                return false;
+            }
+            write->done = false;
+            write->_next = nullptr;
+
+            // the TX done interrupt is the only other place that touches the queues
+            hardware.setInterruptTxTransferDone(false);
+
+            UARTWrite *&first = urgent ? _first_urgent_write : _first_write;
+            UARTWrite *&last = urgent ? _last_urgent_write : _last_write;
+            if (last == nullptr) {
+                first = write;
+            } else {
+                last->_next = write;
+            }
+            last = write;
+
+            _startNextTransfer();
+
+            // if that didn't start it, then something else is being sent, and we'll try again when
+            // it's done
+            _resumeTxDoneInterrupt();
+            return true;
+        };
+
+        void _resumeTxDoneInterrupt() {
+            if ((_active_write != nullptr) || _tx_transfer_active) {
+                hardware.setInterruptTxTransferDone(true);
+            }
+        };
+
+        bool _startWriteFrom(UARTWrite *&first, UARTWrite *&last) {
+            UARTWrite *write = first;
+            if (write == nullptr) {
+                return false;
+            }
+            // starting the DMA turns the done interrupt on, so take it off the queue before then
+            first = write->_next;
+            if (first == nullptr) {
+                last = nullptr;
+            }
+            write->_next = nullptr;
+            _active_write = write;
+            // The DMA only reads from the buffer
+            if (!hardware.startTXTransfer(const_cast<char *>(reinterpret_cast<const char *>(write->data)), write->length)) {
+                // put it back
+                _active_write = nullptr;
+                write->_next = first;
+                if (first == nullptr) {
+                    last = write;
+                }
+                first = write;
+                return false;
+            }
+            return true;
+        };
+
+        bool _startTransfer(char *buffer, const uint16_t length) {
+            // set before starting, in case the done interrupt fires before we return
+            char *const previous_end = _tx_transfer_end;
+            _tx_transfer_end = buffer + length;
+            _tx_transfer_active = true;
+            if (!hardware.startTXTransfer(buffer, length)) {
+                _tx_transfer_active = false;
+                _tx_transfer_end = previous_end;
+                return false;
+            }
+            return true;
+        };
+
+        // Start whatever is next: an urgent write, then a held startTXTransfer() transfer, then
+        // (unless urgent_only) a normal write if nothing from startTXTransfer() is waiting.
+        void _startNextTransfer(const bool urgent_only = false) {
+            if ((_active_write != nullptr) || _tx_transfer_active) {
+                return;
+            }
+            if (_startWriteFrom(_first_urgent_write, _last_urgent_write)) {
+                return;
+            }
+            if (_pending_tx_buffer != nullptr) {
+                if (_startTransfer(_pending_tx_buffer, _pending_tx_length)) {
+                    _pending_tx_buffer = nullptr;
+                }
+                return;
+            }
+            if (urgent_only) {
+                return;
+            }
+            _startWriteFrom(_first_write, _last_write);
+        };
+
+        // called from the TX done interrupt
+        void _writeDone() {
+            UARTWrite *write = _active_write;
+            if (write != nullptr) {
+                // nothing else can start while a queued write is being sent, so this is the one that's done
+                _active_write = nullptr;
+
+                write->done = true;
+                if (write->done_callback) {
+                    write->done_callback();
+                }
+                readiness.notify(Readiness::kDone);
+            }
+        };
+
         // **** Transfers and handling transfers
 
         void setConnectionCallback(std::function<void(bool)> &&callback) {
@@ -300,15 +599,18 @@ namespace Motate {
 
 
         bool _addTransfer(char *start, uint16_t length, char *high_water_start) {
+            if (_xon_xoff) { _scanRX(); }
             if (!hardware.startRXTransfer(start, length)) { return false; }
             if (!hardware.startRXTransfer(high_water_start, highWaterChars)) { return false; }
             hardware.setInterruptRxTransferDone(true);
+            if (_xon_xoff) { _rx_scanned = hardware.getRXTransferPosition(); }
             _startRX();
             return true;
         }
 
         void _transactionEnded() {
             // this is called from the interupt when a transaction is done
+            if (_xon_xoff) { _scanRX(); }
             _stopRX();
             hardware.setInterruptRxTransferDone(false);
             if (transfer_rx_done_callback) {
@@ -340,6 +642,10 @@ namespace Motate {
         };
 
         char* getRXTransferPosition() {
+            if (_xon_xoff) {
+                _scanRX();
+                return _rx_scanned;
+            }
             return hardware.getRXTransferPosition();
         };
 
@@ -347,16 +653,44 @@ namespace Motate {
             transfer_rx_done_callback = std::move(callback);
         }
 
+        // When the RX line goes idle for bit_times bit periods after receiving something, call
+        // callback (from the interrupt) so the caller can pick up what's arrived so far with
+        // getRXTransferPosition(), without waiting for the transfer to fill.
+        // Returns false if the hardware doesn't have a receiver time-out.
+        bool setRXIdleCallback(const uint32_t bit_times, std::function<void()> &&callback) {
+            rx_idle_callback = std::move(callback);
+            return hardware.setRxIdleTimeout(rx_idle_callback ? bit_times : _defaultRxIdleBitTimes());
+        }
+
 
         bool startTXTransfer(char *buffer, const uint16_t length) {
-            return hardware.startTXTransfer(buffer, length);
-            return false;
-
+            // the TX done interrupt also starts transfers
+            hardware.setInterruptTxTransferDone(false);
+            bool started;
+            if (_active_write != nullptr) {
+                // a queued write has the DMA, so hold this one until it's done
+                _pending_tx_buffer = buffer;
+                _pending_tx_length = length;
+                _tx_transfer_end = buffer; // nothing of it has been sent yet
+                started = true;
+            } else {
+                started = _startTransfer(buffer, length);
+            }
+            _resumeTxDoneInterrupt();
+            return started;
         };
 
+        // The position in the last buffer given to startTXTransfer(), even while a queued write is
+        // what the DMA is actually sending.
         char* getTXTransferPosition() {
-            return hardware.getTXTransferPosition();
-            return nullptr;
+            if (_tx_transfer_active) {
+                char *position = hardware.getTXTransferPosition();
+                // if it finished (and a queued write started) while we looked, use where it ended
+                if (_tx_transfer_active) {
+                    return position;
+                }
+            }
+            return _tx_transfer_end;
         };
 
         void setTXTransferDoneCallback(std::function<void()> &&callback) {
@@ -380,14 +714,35 @@ namespace Motate {
             }
 
             if (interruptCause & UARTInterrupt::OnTxTransferDone) {
-                if (transfer_tx_done_callback) {
-                    hardware.setInterruptTxTransferDone(false);
+                // starting another transfer (here or from the callback) turns it back on
+                hardware.setInterruptTxTransferDone(false);
+                // only one of these was in the DMA
+                const bool transfer_done = _tx_transfer_active;
+                _tx_transfer_active = false;
+                _writeDone();
+                // urgent writes go before whatever the callback would send next, which is held by
+                // startTXTransfer() until they're done
+                _startNextTransfer(/*urgent_only:*/ true);
+                if (transfer_done && transfer_tx_done_callback) {
                     transfer_tx_done_callback();
                 }
+                _startNextTransfer();
+                readiness.notify(Readiness::kWritable);
             }
 
             if (interruptCause & UARTInterrupt::OnRxTransferDone) {
                 _transactionEnded();
+                readiness.notify(Readiness::kReadable);
+            }
+
+            if (interruptCause & UARTInterrupt::OnRxIdle) {
+                if (_xon_xoff) {
+                    _scanRX();
+                }
+                if (rx_idle_callback) {
+                    rx_idle_callback();
+                }
+                readiness.notify(Readiness::kReadable);
             }
 
             if (interruptCause & UARTInterrupt::OnCTSChanged) {
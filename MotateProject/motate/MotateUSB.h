@@ -145,6 +145,11 @@ namespace Motate {
         static const uint8_t _interface_0_first_interface = 0; // TODO: Verify this!
         static const uint8_t _total_endpoints_used        = _mixins_type::total_endpoints_used;
 
+        // Endpoints are handed out in order to the interfaces, and every data endpoint is moved by DMA,
+        // so the last one used has to be one of the endpoints that has a DMA channel.
+        static_assert((_interface_0_first_endpoint + _total_endpoints_used - 1) <= _hardware_type::_get_dma_endpoint_max_nbr(),
+                      "USBDevice interfaces use more endpoints than the USB hardware has DMA channels for.");
+
         using _hardware_type::config_number;
         using _hardware_type::SETUP;
 
@@ -438,6 +443,28 @@ namespace Motate {
         };
     }; // USBDevice<...>
 
+#pragma mark USBRepeatedDevice<USBHW_t, count, interfaceType, otherTypes...>
+    // USBRepeatedDevice makes a USBDevice with count copies of interfaceType, followed by any otherTypes.
+    // Each copy is a separate function with its own interfaces, endpoints, and (for USBCDC) its own
+    // USBSerial, retrieved with usb.mixin<n>. For example, two virtual serial ports:
+    //
+    //  Motate::USBRepeatedDevice<Motate::USBDeviceHardware, 2, Motate::USBCDC> usb;
+    //  auto &SerialUSB  = usb.mixin<0>::Serial;
+    //  auto &SerialUSB1 = usb.mixin<1>::Serial;
+
+    template <typename USBHW_t, uint8_t count, typename interfaceType, typename... otherTypes>
+    struct _USBRepeatedDevice {
+        typedef typename _USBRepeatedDevice<USBHW_t, count-1, interfaceType, interfaceType, otherTypes...>::type type;
+    };
+
+    template <typename USBHW_t, typename interfaceType, typename... otherTypes>
+    struct _USBRepeatedDevice<USBHW_t, 0, interfaceType, otherTypes...> {
+        typedef USBDevice<USBHW_t, otherTypes...> type;
+    };
+
+    template <typename USBHW_t, uint8_t count, typename interfaceType, typename... otherTypes>
+    using USBRepeatedDevice = typename _USBRepeatedDevice<USBHW_t, count, interfaceType, otherTypes...>::type;
+
 
 
 #pragma mark struct USBMixin<>
@@ -673,7 +700,7 @@ namespace Motate {
     struct USBDefaultDescriptor <interfaceType> : USBDescriptorDevice_t {
         USBDefaultDescriptor(const uint16_t vendorID, const uint16_t productID, const uint16_t productVersionBCD, const USBDeviceSpeed_t deviceSpeed) :
         USBDescriptorDevice_t{
-                              /*    USBSpecificationBCD = */ USBFloatToBCD(2.0),
+                              /*    USBSpecificationBCD = */ (uint16_t)(USBInterfaceNeedsBOS<interfaceType>::value ? USBFloatToBCD(2.1) : USBFloatToBCD(2.0)),
                               /*                  Class = */ kNoDeviceClass,
                               /*               SubClass = */ kNoDeviceSubclass,
                               /*               Protocol = */ kNoDeviceProtocol,
@@ -696,11 +723,12 @@ namespace Motate {
 
     // If we have multiple intefaces, we'll usa an Interface Association Descriptor
     // Ths is used for binding multiple descriptors together when we have multiple interfaces
+    // IADs are a USB 2.0 addition, and some hosts ignore them (and the device class) on a 1.1 device.
     template < typename interface0type, typename interface1type, typename... interfaceOtherTypes >
     struct USBDefaultDescriptor <interface0type, interface1type, interfaceOtherTypes...> : USBDescriptorDevice_t {
         USBDefaultDescriptor(const uint16_t vendorID, const uint16_t productID, const uint16_t productVersion, const USBDeviceSpeed_t deviceSpeed) :
         USBDescriptorDevice_t{
-                              /*    USBSpecificationBCD = */ USBFloatToBCD(1.1),
+                              /*    USBSpecificationBCD = */ (uint16_t)(USBAnyInterfaceNeedsBOS<interface0type, interface1type, interfaceOtherTypes...>::value ? USBFloatToBCD(2.1) : USBFloatToBCD(2.0)),
                               /*                  Class = */ kIADDeviceClass,
                               /*               SubClass = */ kIADDeviceSubclass,
                               /*               Protocol = */ kIADDeviceProtocol,
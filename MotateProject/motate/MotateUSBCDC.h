@@ -34,7 +34,9 @@
 #include "MotateUSBHelpers.h"
 #include <functional>
 #include <type_traits> // for enable_if
+#include <atomic>
 #include "MotatePower.h"
+#include "MotateReadiness.h"
 
 namespace Motate {
 
@@ -242,6 +244,28 @@ namespace Motate {
         static const uint8_t endpoints_used = (uint8_t)3;
     };
 
+#pragma mark USBSerialWrite
+
+    // A caller-owned block of data for USBSerial::queueWrite(). The data is sent directly by DMA,
+    // without copying, so it (and this) must stay valid and unchanged until done is true.
+    struct USBSerialWrite {
+        const uint8_t *data = nullptr;
+        uint16_t length = 0;
+
+        std::function<void(void)> done_callback; // called from the interrupt once the data is sent, may be empty
+        volatile bool done = true;
+
+        USBSerialWrite *_next = nullptr; // maintained by the USBSerial
+
+        USBSerialWrite *setup(const uint8_t *new_data, const uint16_t new_length) {
+            data = new_data;
+            length = new_length;
+            done = false;
+            _next = nullptr;
+            return this;
+        };
+    };
+
 #pragma mark USBSerial
 
     //Actual implementation of CDC
@@ -257,6 +281,10 @@ namespace Motate {
         std::function<void(void)> transfer_rx_done_callback;
         std::function<void(void)> transfer_tx_done_callback;
 
+        // kReadable as each packet arrives (watching it turns on the per-packet OUT interrupt) and when an
+        // RX transfer is done, kWritable when a transfer is sent, kDone when a queued write is done
+        ReadinessSource readiness;
+
         struct _line_info_t
         {
             uint32_t dwDTERate;
@@ -287,7 +315,14 @@ namespace Motate {
         write_endpoint(new_endpoint_offset+2),
         interface_number(new_interface_number),
         _line_state(0x00)
-        {};
+        {
+            readiness.watched_callback = [&](const Readiness::Type events) {
+                if (events & Readiness::kReadable) {
+                    // bulk OUT transfers otherwise only interrupt when they're done (or full)
+                    usb.enableRXInterrupt(read_endpoint);
+                }
+            };
+        };
 
         USBSerial(const USBSerial&) = delete;
         USBSerial(USBSerial&& other) = delete;
@@ -340,13 +375,29 @@ namespace Motate {
         };
 
         USB_DMA_Descriptor _rx_dma_descriptor;
-        // for now we ignore buffer2 and length2
+        USB_DMA_Descriptor _rx_dma_descriptor2;
+        // buffer2 (if length2 isn't 0) is chained after buffer, so a ring buffer can be filled across the
+        // wrap in one transfer
         bool startRXTransfer(char *buffer, const uint16_t length, char *buffer2, const uint16_t length2) {
             _rx_dma_descriptor.setBuffer(buffer, length);
+            _rx_dma_descriptor2.setBuffer(buffer2, length2);
             // // DON'T allow the DMA transfer to be stopped if the buffer runs out
             // // IOW, don't stop reading when a packet doesn't fill the buffer.
             // _rx_dma_descriptor.end_buffer_enable = false;
-            return usb.transfer(read_endpoint, _rx_dma_descriptor);
+            _rx_dma_descriptor.end_transfer_enable = false;
+            _rx_dma_descriptor.end_transfer_interrupt_enable = false;
+            _rx_dma_descriptor2.end_transfer_enable = false;
+            _rx_dma_descriptor2.end_transfer_interrupt_enable = false;
+            return usb.transfer(read_endpoint, _rx_dma_descriptor, &_rx_dma_descriptor2);
+        };
+
+        // Like startRXTransfer, but the transfer also ends after a short packet. With length set to
+        // the endpoint size, that makes it done after every packet the host sends.
+        bool startRXPacketTransfer(char *buffer, const uint16_t length) {
+            _rx_dma_descriptor.setBuffer(buffer, length);
+            _rx_dma_descriptor.end_transfer_enable = true;
+            _rx_dma_descriptor.end_transfer_interrupt_enable = true;
+            return usb.transfer(read_endpoint, _rx_dma_descriptor, nullptr);
         };
 
         char* getRXTransferPosition() {
@@ -363,7 +414,78 @@ namespace Motate {
 
 
         USB_DMA_Descriptor _tx_dma_descriptor;
+        std::atomic<bool> _tx_busy {false}; // whoever sets this owns the write endpoint (and the write queues)
+        std::atomic<uint32_t> _tx_requests {0}; // counts writes and transfers asked for, to catch ones that race a release
+
+        // Transfers from startTXTransfer() (the TXBuffer) share the write endpoint with queued
+        // writes. A transfer asked for while the endpoint is busy is held here and started by
+        // whoever owns it next, so startTXTransfer() doesn't fail (and TXBuffer::_restartTransfer()
+        // doesn't spin) just because a queued write has the endpoint.
+        std::atomic<bool> _pending_tx {false};
+        char *_pending_tx_buffer = nullptr;
+        uint16_t _pending_tx_length = 0;
+        volatile bool _tx_transfer_active = false;
+        char * volatile _tx_transfer_end = nullptr; // where the last transfer from startTXTransfer() ends
+        uint16_t _tx_transfer_length = 0;
+
+        // Returns false only if the transfer couldn't be started. If the endpoint is busy, the
+        // transfer is held and started after what's being sent, and this returns true.
         bool startTXTransfer(char *buffer, const uint16_t length) {
+            if (_claimTX()) {
+                if (_startTransfer(buffer, length)) {
+                    return true;
+                }
+                _tx_busy = false;
+                return false;
+            }
+
+            _pending_tx_buffer = buffer;
+            _pending_tx_length = length;
+            _tx_transfer_end = buffer; // nothing of it has been sent yet
+            _pending_tx = true;
+            ++_tx_requests;
+            _serviceTX();
+            return true;
+        };
+
+        bool _claimTX() {
+            bool expected = false;
+            return _tx_busy.compare_exchange_strong(expected, true);
+        };
+
+        // Start what's next if nothing is being sent. If something is asked for while we own the
+        // endpoint and find nothing to do, go around again so it isn't left waiting.
+        void _serviceTX(const bool urgent_only = false) {
+            uint32_t requests = _tx_requests;
+            while (_claimTX()) {
+                if (_startNextTransfer(urgent_only)) {
+                    return;
+                }
+                _tx_busy = false;
+                const uint32_t new_requests = _tx_requests;
+                if (new_requests == requests) {
+                    return;
+                }
+                requests = new_requests;
+            }
+        };
+
+        // Only call this after _claimTX()
+        bool _startTransfer(char *buffer, const uint16_t length) {
+            char *const previous_end = _tx_transfer_end;
+            _tx_transfer_end = buffer + length;
+            _tx_transfer_length = length;
+            _tx_transfer_active = true;
+            if (!_startTX(buffer, length)) {
+                _tx_transfer_active = false;
+                _tx_transfer_end = previous_end;
+                return false;
+            }
+            return true;
+        };
+
+        // Only call this after _claimTX()
+        bool _startTX(char *buffer, const uint16_t length) {
             _tx_dma_descriptor.setBuffer(buffer, length);
             // // Allow the DMA transfer to be stopped if the buffer runs out.
             // // IOW, send a partially filled packet.
@@ -371,8 +493,169 @@ namespace Motate {
             return usb.transfer(write_endpoint, _tx_dma_descriptor);
         };
 
+        // Writes are pushed onto these by any context, then moved to the queues below by whoever
+        // owns the write endpoint.
+        std::atomic<USBSerialWrite*> _incoming_writes {nullptr};
+        std::atomic<USBSerialWrite*> _incoming_urgent_writes {nullptr};
+
+        // Queued writes, urgent ones are sent before any normal ones that haven't started yet
+        USBSerialWrite *_first_write = nullptr;
+        USBSerialWrite *_last_write = nullptr;
+        USBSerialWrite *_first_urgent_write = nullptr;
+        USBSerialWrite *_last_urgent_write = nullptr;
+        USBSerialWrite * volatile _active_write = nullptr; // taken off its queue, and being sent
+
+        // Send write->data by DMA, after anything already sent or queued, without copying it.
+        // write->done is set and write->done_callback is called when it's been sent.
+        //
+        // Normal writes go after any transfers from startTXTransfer() (the TXBuffer), so they are
+        // sent after what was written to the TXBuffer before them. They only start once the
+        // TXBuffer has nothing left to send, so a TXBuffer that is kept full holds them back.
+        //
+        // If urgent is true, it's sent as soon as the current transfer is done, ahead of any normal
+        // queued writes and of the next transfer started from the TX done callback. Writes are never
+        // split, so an urgent write waits for at most one transfer.
+        //
+        // Sequence with an urgent write queued while the TXBuffer has data:
+        //   1. TXBuffer transfer A is being sent, urgent write U is queued
+        //   2. A is done: U is started, then the TX done callback asks for TXBuffer transfer B,
+        //      which is held (startTXTransfer() returns true)
+        //   3. U is done: B is started, and getTXTransferPosition() reported the end of A until then
+        //
+        // Safe to call from any context, including interrupts.
+        bool queueWrite(USBSerialWrite *write, const bool urgent = false) {
+            if (write->length == 0) {
+                return false;
+            }
+            write->done = false;
+
+            std::atomic<USBSerialWrite*> &incoming = urgent ? _incoming_urgent_writes : _incoming_writes;
+            USBSerialWrite *head = incoming.load();
+            do {
+                write->_next = head;
+            } while (!incoming.compare_exchange_weak(head, write));
+            ++_tx_requests;
+
+            // if we can't claim it, then something else is being sent, and we'll try again when
+            // it's done
+            _serviceTX();
+            return true;
+        };
+
+        // Move everything from incoming to the end of the queue, in the order it was queued.
+        static void _sortIncoming(std::atomic<USBSerialWrite*> &incoming, USBSerialWrite *&first, USBSerialWrite *&last) {
+            USBSerialWrite *reversed = incoming.exchange(nullptr);
+            USBSerialWrite *walker = nullptr;
+            while (reversed != nullptr) {
+                USBSerialWrite *next = reversed->_next;
+                reversed->_next = walker;
+                walker = reversed;
+                reversed = next;
+            }
+
+            if (walker == nullptr) {
+                return;
+            }
+            if (last == nullptr) {
+                first = walker;
+            } else {
+                last->_next = walker;
+            }
+            while (walker->_next != nullptr) {
+                walker = walker->_next;
+            }
+            last = walker;
+        };
+
+        bool _startWriteFrom(USBSerialWrite *&first, USBSerialWrite *&last) {
+            USBSerialWrite *write = first;
+            if (write == nullptr) {
+                return false;
+            }
+            // the done interrupt may come before _startTX() returns, so take it off the queue first
+            first = write->_next;
+            if (first == nullptr) {
+                last = nullptr;
+            }
+            write->_next = nullptr;
+            _active_write = write;
+            // The DMA only reads from the buffer
+            if (!_startTX(const_cast<char *>(reinterpret_cast<const char *>(write->data)), write->length)) {
+                // put it back
+                _active_write = nullptr;
+                write->_next = first;
+                if (first == nullptr) {
+                    last = write;
+                }
+                first = write;
+                return false;
+            }
+            return true;
+        };
+
+        // Only call this after _claimTX(). Returns true if something was started: an urgent write,
+        // then a held startTXTransfer() transfer, then (unless urgent_only) a normal write.
+        bool _startNextTransfer(const bool urgent_only = false) {
+            _sortIncoming(_incoming_urgent_writes, _first_urgent_write, _last_urgent_write);
+            if (_startWriteFrom(_first_urgent_write, _last_urgent_write)) {
+                return true;
+            }
+            if (_pending_tx) {
+                if (_startTransfer(_pending_tx_buffer, _pending_tx_length)) {
+                    _pending_tx = false;
+                    return true;
+                }
+                // normal writes stay behind it
+                return false;
+            }
+            if (urgent_only) {
+                return false;
+            }
+            _sortIncoming(_incoming_writes, _first_write, _last_write);
+            return _startWriteFrom(_first_write, _last_write);
+        };
+
+        // called from the USB interrupt when the write endpoint is done
+        void _writeDone() {
+            // only one of these was on the endpoint
+            const bool transfer_done = _tx_transfer_active;
+            _tx_transfer_active = false;
+            USBSerialWrite *write = _active_write;
+            _active_write = nullptr;
+            _tx_busy = false;
+
+            if (write != nullptr) {
+                write->done = true;
+                if (write->done_callback) {
+                    write->done_callback();
+                }
+                readiness.notify(Readiness::kDone);
+            }
+
+            // urgent writes go before whatever the callback would send next, which is held by
+            // startTXTransfer() until they're done
+            _serviceTX(/*urgent_only:*/ true);
+
+            if (transfer_done && transfer_tx_done_callback) {
+                transfer_tx_done_callback();
+            }
+
+            _serviceTX();
+
+            readiness.notify(Readiness::kWritable);
+        };
+
+        // The position in the last buffer given to startTXTransfer(), even while a queued write is
+        // what the DMA is actually sending.
         char* getTXTransferPosition() {
-            return usb.getTransferPositon(write_endpoint);
+            if (_tx_transfer_active) {
+                char *position = usb.getTransferPositon(write_endpoint);
+                // if it finished (and a queued write started) while we looked, use where it ended
+                if (_tx_transfer_active) {
+                    return position;
+                }
+            }
+            return _tx_transfer_end;
         };
 
         void setTXTransferDoneCallback(const std::function<void()> &callback) {
@@ -467,6 +750,8 @@ namespace Motate {
             }
         }
 
+        // callback is called from the USB interrupt as each packet arrives. length is 0 where the DMA has
+        // already moved the packet (the SAM USB hardware), so use getRXTransferPosition() to see how far it got.
         void setDataAvailableCallback(const std::function<void(const size_t &length)> &callback) {
             usb.enableRXInterrupt(read_endpoint);
             data_available_callback = callback;
@@ -480,6 +765,9 @@ namespace Motate {
         // This is to be called from USBDeviceHardware when new data is available.
         // It returns if the request was handled or not.
         bool handleDataAvailable(const uint8_t &endpointNum, const size_t &length) {
+            if (endpointNum == read_endpoint) {
+                readiness.notify(Readiness::kReadable);
+            }
             if (data_available_callback && (endpointNum == read_endpoint)) {
                 data_available_callback(length);
                 return true;
@@ -490,12 +778,15 @@ namespace Motate {
         // This is to be called from USBDeviceHardware when a transfer is done.
         // It returns if the request was handled or not.
         bool handleTransferDone(const uint8_t &endpointNum) {
+            if (endpointNum == read_endpoint) {
+                readiness.notify(Readiness::kReadable);
+            }
             if (transfer_rx_done_callback && (endpointNum == read_endpoint)) {
                 transfer_rx_done_callback();
                 return true;
             }
-            if (transfer_tx_done_callback && (endpointNum == write_endpoint)) {
-                transfer_tx_done_callback();
+            if (endpointNum == write_endpoint) {
+                _writeDone();
                 return true;
             }
             return false;
@@ -561,6 +852,28 @@ namespace Motate {
             // We only connection_state_changed_callback(true) when the DTR changes,
             // which is later than this hardware change, and happens when host software
             // connects
+            if (!connected && _tx_busy) {
+                // The transfer won't finish, so let go of the endpoint. A write that was being sent
+                // goes back on the front of the queue, to be sent whole when we're reconnected.
+                USBSerialWrite *write = _active_write;
+                if (write != nullptr) {
+                    _active_write = nullptr;
+                    write->_next = _first_urgent_write;
+                    _first_urgent_write = write;
+                    if (_last_urgent_write == nullptr) {
+                        _last_urgent_write = write;
+                    }
+                }
+                // Same for a transfer from startTXTransfer()
+                if (_tx_transfer_active) {
+                    _tx_transfer_active = false;
+                    _pending_tx_buffer = _tx_transfer_end - _tx_transfer_length;
+                    _pending_tx_length = _tx_transfer_length;
+                    _tx_transfer_end = _pending_tx_buffer;
+                    _pending_tx = true;
+                }
+                _tx_busy = false;
+            }
             if (connection_state_changed_callback && !connected) {
                 _line_info_valid = false;
                 _line_state = 0;
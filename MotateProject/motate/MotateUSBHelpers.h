@@ -96,6 +96,8 @@ namespace Motate {
         kOtherDescriptor                = 0x07, /* other type. */
         kInterfacePowerDescriptor       = 0x08, /* interface power descriptor. */
         kInterfaceAssociationDescriptor = 0x0B, /* interface association descriptor. */
+        kBOSDescriptor                  = 0x0F, /* binary device object store descriptor (USB 2.1+). */
+        kDeviceCapabilityDescriptor     = 0x10, /* device capability descriptor, inside the BOS. */
         kCSInterfaceDescriptor          = 0x24, /* class specific interface descriptor. */
         kCSEndpointDescriptor           = 0x25, /* class specific endpoint descriptor. */
     };
@@ -416,6 +418,24 @@ namespace Motate {
     template < typename... usb_interface_types > struct USBDefaultDescriptor;
     template < typename... usb_interface_types > struct USBDefaultQualifier;
 
+    // Interfaces that need the host to ask for the BOS descriptor (such as for MS OS 2.0 descriptors)
+    // specialize this to be true, which makes the default device descriptor say USB 2.1.
+    template < typename usb_interface_type >
+    struct USBInterfaceNeedsBOS {
+        static const bool value = false;
+    };
+
+    template < typename... usb_interface_types >
+    struct USBAnyInterfaceNeedsBOS {
+        static const bool value = false;
+    };
+
+    template < typename usb_first_interface_type, typename... usb_other_interface_types >
+    struct USBAnyInterfaceNeedsBOS <usb_first_interface_type, usb_other_interface_types...> {
+        static const bool value = USBInterfaceNeedsBOS<usb_first_interface_type>::value ||
+                                  USBAnyInterfaceNeedsBOS<usb_other_interface_types...>::value;
+    };
+
     // Forward declare the USBMixin template.
     // Mixins are described more below.
     template < typename... usb_interface_types > struct USBConfigMixins;
@@ -992,6 +1012,10 @@ namespace Motate {
             return (_bmRequestType == (kRequestHostToDevice | kRequestClass | kRequestInterface));
         };
 
+        const bool isADeviceToHostVendorDeviceRequest() const {
+            return (_bmRequestType == (kRequestDeviceToHost | kRequestVendor | kRequestDevice));
+        };
+
         const bool requestIs(uint8_t testRequest) const {
             return _bRequest == testRequest;
         };
@@ -0,0 +1,669 @@
+/*
+  MotateUSBVendor.h - Vendor-specific bulk USB interface for the Motate system
+  http://github.com/synthetos/motate/
+
+  Copyright (c) 2018 Robert Giseburt
+
+	This file is part of the Motate Library.
+
+	This file ("the software") is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License, version 2 as published by the
+	Free Software Foundation. You should have received a copy of the GNU General Public
+	License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+	As a special exception, you may use this file as part of a software library without
+	restriction. Specifically, if other files instantiate templates or use macros or
+	inline functions from this file, or you compile this file and link it with  other
+	files to produce an executable, this file does not by itself cause the resulting
+	executable to be covered by the GNU General Public License. This exception does not
+	however invalidate any other reasons why the executable file might be covered by the
+	GNU General Public License.
+
+	THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+	WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+	OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+	SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+	OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef MOTATEUSBVENDOR_H_ONCE
+#define MOTATEUSBVENDOR_H_ONCE
+
+#include "MotateUSB.h"
+#include <functional>
+#include <atomic>
+#include <new> // for placement new
+#include "MotateReadiness.h"
+
+/* USBVendorBulk is a vendor-specific (class 0xFF) interface with one bulk OUT and one bulk IN
+ * endpoint, with no line discipline or class requests in the way. It's meant for libusb or WinUSB
+ * on the host side, and may be used alone or next to USBCDC interfaces:
+ *
+ *   Motate::USBDevice<Motate::USBDeviceHardware, Motate::USBCDC, Motate::USBVendorBulk> usb;
+ *   auto &SerialUSB = usb.mixin<0>::Serial;
+ *   auto &Vendor    = usb.mixin<1>::Vendor;
+ *
+ * Data moves with zero-copy transfers: a USBVendorTransfer points at the caller's buffer, is
+ * submitted with submitRead() or submitWrite(), and is DMAed directly to or from that buffer. Any
+ * number may be submitted, and they're done in order. The done flag is set and done_callback is
+ * called (from the USB interrupt) when each one is finished. Each transfer may use two buffers
+ * (such as the two halves of a wrapped ring buffer) of up to 65535 bytes each, and runs in hardware with
+ * one interrupt at the end.
+ *
+ * A read ends when its buffers are full or the host ends its transfer with a short packet, and
+ * actual_length says how much arrived. Reads should be a multiple of the endpoint size (512 at high
+ * speed) to be sure a host transfer isn't split.
+ *
+ * So that Windows binds WinUSB without an INF, the device answers the BOS descriptor request with an
+ * MS OS 2.0 platform capability, and the MS OS 2.0 vendor request with a compatible ID of "WINUSB"
+ * and a DeviceInterfaceGUIDs registry property (see setInterfaceGUID()). With this interface
+ * present the device descriptor says USB 2.1, since that's when Windows asks for the BOS.
+ * Only one USBVendorBulk may be used in a device.
+ */
+
+namespace Motate {
+
+    /* ############################################ */
+    /* #                                          # */
+    /* #       MS OS 2.0 and BOS Descriptors      # */
+    /* #                                          # */
+    /* ############################################ */
+
+    enum MSOS20Constants_t {
+        kMSOS20VendorCode          = 0x4D, // the bRequest of the MS OS 2.0 vendor request, our choice
+        kMSOS20DescriptorIndex     = 0x07, // the wIndex of the MS OS 2.0 vendor request
+
+        kMSOS20SetHeader           = 0x00,
+        kMSOS20SubsetConfiguration = 0x01,
+        kMSOS20SubsetFunction      = 0x02,
+        kMSOS20FeatureCompatibleID = 0x03,
+        kMSOS20FeatureRegProperty  = 0x04,
+
+        kMSOS20RegMultiSZ          = 0x07,
+    };
+
+    static const uint32_t kMSOS20WindowsVersion = 0x06030000; // Windows 8.1, the first with MS OS 2.0
+
+    // Length of a "{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}" GUID string, in characters.
+    static const uint8_t kMSOS20GUIDLength = 38;
+
+#pragma mark USBDescriptorBOS_t
+    // The BOS descriptor, with a USB 2.0 Extension capability and an MS OS 2.0 platform capability.
+    struct USBDescriptorBOS_t
+    {
+        USBDescriptorHeader_t Header;
+        uint16_t TotalLength;        /* Size of this and all of the capabilities that follow. */
+        uint8_t  TotalDeviceCaps;
+
+        // USB 2.0 Extension (required with a bcdUSB of 2.1)
+        USBDescriptorHeader_t USB20ExtensionHeader;
+        uint8_t  USB20ExtensionCapabilityType;
+        uint32_t USB20ExtensionAttributes; /* bit 1 is LPM, which we don't support */
+
+        // MS OS 2.0 Platform Capability
+        USBDescriptorHeader_t PlatformHeader;
+        uint8_t  PlatformCapabilityType;
+        uint8_t  PlatformReserved;
+        uint8_t  PlatformUUID[16];   /* {D8DD60DF-4589-4CC7-9CD2-659D9E648A9F}, in USB byte order */
+        uint32_t WindowsVersion;
+        uint16_t MSOSDescriptorSetTotalLength;
+        uint8_t  MSOSVendorCode;
+        uint8_t  AltEnumCode;
+
+        USBDescriptorBOS_t(const uint16_t _ms_os_descriptor_set_length)
+        : Header{5, kBOSDescriptor},
+        TotalLength{sizeof(USBDescriptorBOS_t)},
+        TotalDeviceCaps{2},
+
+        USB20ExtensionHeader{7, kDeviceCapabilityDescriptor},
+        USB20ExtensionCapabilityType{0x02},
+        USB20ExtensionAttributes{0},
+
+        PlatformHeader{28, kDeviceCapabilityDescriptor},
+        PlatformCapabilityType{0x05},
+        PlatformReserved{0},
+        PlatformUUID{0xDF, 0x60, 0xDD, 0xD8, 0x89, 0x45, 0xC7, 0x4C, 0x9C, 0xD2, 0x65, 0x9D, 0x9E, 0x64, 0x8A, 0x9F},
+        WindowsVersion{kMSOS20WindowsVersion},
+        MSOSDescriptorSetTotalLength{_ms_os_descriptor_set_length},
+        MSOSVendorCode{kMSOS20VendorCode},
+        AltEnumCode{0}
+        {};
+    } ATTR_PACKED;
+
+#pragma mark MSOS20SetHeader_t
+    struct MSOS20SetHeader_t
+    {
+        uint16_t Length;
+        uint16_t DescriptorType;
+        uint32_t WindowsVersion;
+        uint16_t TotalLength;        /* Size of the whole MS OS 2.0 descriptor set. */
+
+        MSOS20SetHeader_t(const uint16_t _total_length)
+        : Length{sizeof(MSOS20SetHeader_t)},
+        DescriptorType{kMSOS20SetHeader},
+        WindowsVersion{kMSOS20WindowsVersion},
+        TotalLength{_total_length}
+        {};
+    } ATTR_PACKED;
+
+#pragma mark MSOS20SubsetHeaders_t
+    // In a composite device the features have to be scoped to the function's first interface.
+    struct MSOS20SubsetHeaders_t
+    {
+        uint16_t ConfigurationLength;
+        uint16_t ConfigurationDescriptorType;
+        uint8_t  ConfigurationValue; /* The configuration index, not bConfigurationValue. */
+        uint8_t  ConfigurationReserved;
+        uint16_t ConfigurationTotalLength;
+
+        uint16_t FunctionLength;
+        uint16_t FunctionDescriptorType;
+        uint8_t  FirstInterface;
+        uint8_t  FunctionReserved;
+        uint16_t FunctionSubsetLength;
+
+        MSOS20SubsetHeaders_t(const uint8_t _first_interface, const uint16_t _features_length)
+        : ConfigurationLength{8},
+        ConfigurationDescriptorType{kMSOS20SubsetConfiguration},
+        ConfigurationValue{0},
+        ConfigurationReserved{0},
+        ConfigurationTotalLength{(uint16_t)(sizeof(MSOS20SubsetHeaders_t) + _features_length)},
+
+        FunctionLength{8},
+        FunctionDescriptorType{kMSOS20SubsetFunction},
+        FirstInterface{_first_interface},
+        FunctionReserved{0},
+        FunctionSubsetLength{(uint16_t)(8 + _features_length)}
+        {};
+    } ATTR_PACKED;
+
+#pragma mark MSOS20WinUSBFeatures_t
+    // The compatible ID that loads WinUSB, and the GUID that applications find the device with.
+    struct MSOS20WinUSBFeatures_t
+    {
+        uint16_t CompatibleIDLength;
+        uint16_t CompatibleIDDescriptorType;
+        char     CompatibleID[8];
+        char     SubCompatibleID[8];
+
+        uint16_t PropertyLength;
+        uint16_t PropertyDescriptorType;
+        uint16_t PropertyDataType;
+        uint16_t PropertyNameLength;
+        char16_t PropertyName[21];
+        uint16_t PropertyDataLength;
+        char16_t PropertyData[kMSOS20GUIDLength + 2]; /* REG_MULTI_SZ, so it ends with two nulls */
+
+        MSOS20WinUSBFeatures_t(const char *_guid)
+        : CompatibleIDLength{20},
+        CompatibleIDDescriptorType{kMSOS20FeatureCompatibleID},
+        CompatibleID{'W', 'I', 'N', 'U', 'S', 'B', 0, 0},
+        SubCompatibleID{0, 0, 0, 0, 0, 0, 0, 0},
+
+        PropertyLength{(uint16_t)(sizeof(MSOS20WinUSBFeatures_t) - 20)},
+        PropertyDescriptorType{kMSOS20FeatureRegProperty},
+        PropertyDataType{kMSOS20RegMultiSZ},
+        PropertyNameLength{sizeof(PropertyName)},
+        PropertyDataLength{sizeof(PropertyData)}
+        {
+            const char *name = "DeviceInterfaceGUIDs";
+            for (uint8_t i = 0; i < 21; i++) {
+                PropertyName[i] = name[i]; // includes the null
+            }
+            bool ended = false;
+            for (uint8_t i = 0; i < kMSOS20GUIDLength + 2; i++) {
+                ended = ended || (i >= kMSOS20GUIDLength) || (_guid[i] == 0);
+                PropertyData[i] = ended ? 0 : _guid[i];
+            }
+        };
+    } ATTR_PACKED;
+
+
+    /* ############################################ */
+    /* #                                          # */
+    /* #       USB Vendor-specific Interface      # */
+    /* #                                          # */
+    /* ############################################ */
+
+#pragma mark USBVendorBulk
+
+    // Placeholder for use in end-code
+    // IOW: USBDevice<USBDeviceHardware, USBVendorBulk> usb;
+    // Also, used as the base class for the resulting specialized USBMixin.
+    struct USBVendorBulk {
+        static bool isNull() { return false; };
+        static const uint8_t endpoints_used = (uint8_t)2;
+    };
+
+    template <>
+    struct USBInterfaceNeedsBOS<USBVendorBulk> {
+        static const bool value = true;
+    };
+
+#pragma mark USBVendorTransfer
+
+    // A caller-owned read or write for USBVendorPipes. The data is moved directly by DMA, without
+    // copying, so it (and this) must stay valid, and untouched, until done is true.
+    struct USBVendorTransfer {
+        uint8_t *data = nullptr;
+        uint16_t length = 0;
+        uint8_t *data2 = nullptr;  // optional, continues after data
+        uint16_t length2 = 0;
+
+        uint32_t actual_length = 0; // how much was moved, valid once done is true
+
+        std::function<void(void)> done_callback; // called from the interrupt once it's done, may be empty
+        volatile bool done = true;
+
+        USBVendorTransfer *_next = nullptr; // maintained by the USBVendorPipe
+
+        USBVendorTransfer *setup(uint8_t *new_data, const uint16_t new_length, uint8_t *new_data2 = nullptr, const uint16_t new_length2 = 0) {
+            data = new_data;
+            length = new_length;
+            data2 = new_data2;
+            length2 = new_data2 ? new_length2 : 0;
+            actual_length = 0;
+            done = false;
+            _next = nullptr;
+            return this;
+        };
+    };
+
+#pragma mark USBVendorPipe
+
+    // One direction of a USBVendorPipes: a queue of transfers on one bulk endpoint.
+    template <typename usb_parent_type>
+    struct USBVendorPipe {
+        usb_parent_type &usb;
+        const uint8_t endpoint;
+        const bool is_read;
+
+        USB_DMA_Descriptor _dma_descriptor;
+        USB_DMA_Descriptor _dma_descriptor2;
+        std::atomic<bool> _busy {false}; // whoever sets this owns the endpoint (and the queue)
+        std::atomic<uint32_t> _requests {0}; // counts submits and finished transfers, to catch ones that race a release
+
+        // Transfers are pushed onto this by any context, then moved to the queue below by whoever
+        // owns the endpoint.
+        std::atomic<USBVendorTransfer*> _incoming {nullptr};
+
+        USBVendorTransfer *_first = nullptr;
+        USBVendorTransfer *_last = nullptr;
+        USBVendorTransfer * volatile _active = nullptr; // taken off the queue, and being moved
+
+        USBVendorPipe(usb_parent_type &usb_parent, const uint8_t new_endpoint, const bool new_is_read)
+        : usb(usb_parent), endpoint(new_endpoint), is_read(new_is_read)
+        {};
+
+        USBVendorPipe(const USBVendorPipe&) = delete;
+        USBVendorPipe(USBVendorPipe&& other) = delete;
+
+        // Safe to call from any context, including interrupts.
+        bool submit(USBVendorTransfer *transfer) {
+            if ((transfer->length == 0) || !usb.config_number) {
+                return false;
+            }
+            transfer->done = false;
+            transfer->actual_length = 0;
+
+            USBVendorTransfer *head = _incoming.load();
+            do {
+                transfer->_next = head;
+            } while (!_incoming.compare_exchange_weak(head, transfer));
+
+            ++_requests;
+            _service();
+            return true;
+        };
+
+        bool isIdle() { return !_busy && (_first == nullptr) && (_incoming.load() == nullptr); };
+
+        bool _claim() {
+            bool expected = false;
+            return _busy.compare_exchange_strong(expected, true);
+        };
+
+        // Start the next transfer if nobody owns the endpoint. If we can't claim it, then a transfer is active,
+        // and we'll try again when it's done. If anything was asked for while we held it without starting
+        // a transfer, the owner that saw it might have given up, so look again.
+        void _service() {
+            uint32_t requests = _requests;
+            while (_claim()) {
+                if (_startNext()) {
+                    return;
+                }
+                _busy = false;
+                const uint32_t new_requests = _requests;
+                if (new_requests == requests) {
+                    return;
+                }
+                requests = new_requests;
+            }
+        };
+
+        // Move everything from _incoming to the end of the queue, in the order it was submitted.
+        void _sortIncoming() {
+            USBVendorTransfer *reversed = _incoming.exchange(nullptr);
+            USBVendorTransfer *walker = nullptr;
+            while (reversed != nullptr) {
+                USBVendorTransfer *next = reversed->_next;
+                reversed->_next = walker;
+                walker = reversed;
+                reversed = next;
+            }
+
+            if (walker == nullptr) {
+                return;
+            }
+            if (_last == nullptr) {
+                _first = walker;
+            } else {
+                _last->_next = walker;
+            }
+            while (walker->_next != nullptr) {
+                walker = walker->_next;
+            }
+            _last = walker;
+        };
+
+        // Only call this after _claim(). Returns true if a transfer was started.
+        bool _startNext() {
+            _sortIncoming();
+
+            USBVendorTransfer *transfer = _first;
+            if (transfer == nullptr) {
+                return false;
+            }
+
+            _dma_descriptor.setBuffer(reinterpret_cast<char *>(transfer->data), transfer->length);
+            _dma_descriptor2.setBuffer(reinterpret_cast<char *>(transfer->data2), transfer->length2);
+            // reads end when the host ends its transfer with a short packet, even one in the first buffer
+            _dma_descriptor.end_transfer_enable = is_read;
+            _dma_descriptor.end_transfer_interrupt_enable = is_read;
+            _dma_descriptor2.end_transfer_enable = is_read;
+            _dma_descriptor2.end_transfer_interrupt_enable = is_read;
+
+            // this has to be set before the transfer can possibly finish
+            _active = transfer;
+            if (!usb.transfer(endpoint, _dma_descriptor, &_dma_descriptor2)) {
+                _active = nullptr;
+                return false;
+            }
+
+            _first = transfer->_next;
+            if (_first == nullptr) {
+                _last = nullptr;
+            }
+            transfer->_next = nullptr;
+            return true;
+        };
+
+        // How far the DMA got into the transfer's buffers.
+        uint32_t _transferred(const USBVendorTransfer *transfer) {
+            const uint8_t *position = reinterpret_cast<const uint8_t *>(usb.getTransferPositon(endpoint));
+            if ((position >= transfer->data) && (position < transfer->data + transfer->length)) {
+                // a short packet in the first buffer ended the read, and the second was never started
+                return position - transfer->data;
+            }
+            if (transfer->length2 && (position >= transfer->data2) && (position <= transfer->data2 + transfer->length2)) {
+                return transfer->length + (position - transfer->data2);
+            }
+            if (position == transfer->data + transfer->length) {
+                return transfer->length;
+            }
+            return 0; // the transfer was stopped, such as by a disconnect
+        };
+
+        // called from the USB interrupt when the endpoint is done
+        void _transferDone() {
+            USBVendorTransfer *transfer = _active;
+            if (transfer != nullptr) {
+                transfer->actual_length = _transferred(transfer);
+            }
+            _active = nullptr;
+            _busy = false;
+
+            if (transfer != nullptr) {
+                transfer->done = true;
+                if (transfer->done_callback) {
+                    transfer->done_callback();
+                }
+            }
+
+            ++_requests;
+            _service();
+        };
+    };
+
+#pragma mark USBVendorPipes
+
+    //Actual implementation of the vendor interface
+    template <typename usb_parent_type>
+    struct USBVendorPipes {
+        usb_parent_type &usb;
+        const uint8_t interface_number;
+
+        USBVendorPipe<usb_parent_type> out_pipe; // from the host, read by us
+        USBVendorPipe<usb_parent_type> in_pipe;  // to the host, written by us
+
+        // kReadable when a read is done, kWritable when a write is done, kDone when either is
+        ReadinessSource readiness;
+
+        std::function<void(bool)> connection_state_changed_callback;
+
+        // A placeholder GUID, products should set their own with setInterfaceGUID().
+        const char *_interface_guid = "{4D4F5441-5445-4D4F-5441-544556454E44}";
+
+        USBVendorPipes(usb_parent_type &usb_parent,
+                       const uint8_t new_endpoint_offset,
+                       const uint8_t new_interface_number
+                       )
+        : usb(usb_parent),
+        interface_number(new_interface_number),
+        out_pipe(usb_parent, new_endpoint_offset, /*is_read:*/ true),
+        in_pipe(usb_parent, new_endpoint_offset+1, /*is_read:*/ false)
+        {};
+
+        USBVendorPipes(const USBVendorPipes&) = delete;
+        USBVendorPipes(USBVendorPipes&& other) = delete;
+
+        // Read from the host into transfer->data (then data2). Returns false if the device isn't configured.
+        bool submitRead(USBVendorTransfer *transfer) { return out_pipe.submit(transfer); };
+
+        // Write transfer->data (then data2) to the host. Returns false if the device isn't configured.
+        bool submitWrite(USBVendorTransfer *transfer) { return in_pipe.submit(transfer); };
+
+        bool isConnected() { return usb.config_number != 0; };
+
+        // guid must be a "{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}" string, and stay valid.
+        void setInterfaceGUID(const char *guid) { _interface_guid = guid; };
+
+        void setConnectionStateChangedCallback(std::function<void(bool)> &&callback) {
+            connection_state_changed_callback = std::move(callback);
+        }
+
+        // This is to be called from USBDeviceHardware when a transfer is done.
+        // It returns if the request was handled or not.
+        bool handleTransferDone(const uint8_t &endpointNum) {
+            if (endpointNum == out_pipe.endpoint) {
+                out_pipe._transferDone();
+                readiness.notify(Readiness::kReadable | Readiness::kDone);
+                return true;
+            }
+            if (endpointNum == in_pipe.endpoint) {
+                in_pipe._transferDone();
+                readiness.notify(Readiness::kWritable | Readiness::kDone);
+                return true;
+            }
+            return false;
+        }
+
+        bool _isComposite() const {
+            return usb_parent_type::_mixins_type::total_interfaces_used > 1;
+        };
+
+        uint16_t _msOS20DescriptorSetLength() const {
+            return sizeof(MSOS20SetHeader_t) + (_isComposite() ? sizeof(MSOS20SubsetHeaders_t) : 0) + sizeof(MSOS20WinUSBFeatures_t);
+        };
+
+        bool handleNonstandardRequest(const Setup_t &setup) {
+            if (setup.isADeviceToHostVendorDeviceRequest() &&
+                setup.requestIs(kMSOS20VendorCode) &&
+                (setup.index() == kMSOS20DescriptorIndex))
+            {
+                char *buffer = (char *)USBControlBuffer;
+                char *next = buffer;
+
+                new (next) MSOS20SetHeader_t(_msOS20DescriptorSetLength());
+                next += sizeof(MSOS20SetHeader_t);
+                if (_isComposite()) {
+                    new (next) MSOS20SubsetHeaders_t(interface_number, sizeof(MSOS20WinUSBFeatures_t));
+                    next += sizeof(MSOS20SubsetHeaders_t);
+                }
+                new (next) MSOS20WinUSBFeatures_t(_interface_guid);
+                next += sizeof(MSOS20WinUSBFeatures_t);
+
+                usb.writeToControl(buffer, next - buffer);
+                return true;
+            }
+            return false;
+        };
+
+        bool sendSpecialDescriptorOrConfig(const Setup_t &setup) const {
+            if (setup.valueHigh() == kBOSDescriptor) {
+                USBDescriptorBOS_t *bos = new (&USBControlBuffer) USBDescriptorBOS_t(_msOS20DescriptorSetLength());
+                usb.writeToControl((char *)(bos), sizeof(USBDescriptorBOS_t));
+                return true;
+            }
+            return false;
+        };
+
+        void handleConnectionStateChanged(const bool connected) {
+            // Transfers that were active have been stopped by the hardware, and were reported done.
+            if (connection_state_changed_callback) {
+                connection_state_changed_callback(connected);
+            }
+        }
+
+        const EndpointBufferSettings_t getEndpointSettings(const uint8_t endpoint, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) const {
+            // two banks each, so the host can be moving one packet while the DMA moves the other
+            if (endpoint == out_pipe.endpoint)
+            {
+                uint16_t ep_size = Motate::getEndpointSize(endpoint, kEndpointTypeBulk, deviceSpeed, otherSpeed);
+                const EndpointBufferSettings_t _buffer_size = getBufferSizeFlags(ep_size);
+                return kEndpointBufferOutputFromHost | _buffer_size | kEndpointBufferBlocksUpTo2 | kEndpointBufferTypeBulk;
+            }
+            else if (endpoint == in_pipe.endpoint)
+            {
+                uint16_t ep_size = Motate::getEndpointSize(endpoint, kEndpointTypeBulk, deviceSpeed, otherSpeed);
+                const EndpointBufferSettings_t _buffer_size = getBufferSizeFlags(ep_size);
+                return kEndpointBufferInputToHost | _buffer_size | kEndpointBufferBlocksUpTo2 | kEndpointBufferTypeBulk;
+            }
+            return kEndpointBufferNull;
+        };
+
+        uint16_t getEndpointSize(const uint8_t &endpoint, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) const {
+            if ((endpoint == out_pipe.endpoint) || (endpoint == in_pipe.endpoint))
+            {
+                return Motate::getEndpointSize(endpoint, kEndpointTypeBulk, deviceSpeed, otherSpeed);
+            }
+            return 0;
+        };
+    };
+
+#pragma mark USBMixin< usb_parent_type, position, USBVendorBulk >
+    template <typename usb_parent_type, uint8_t position>
+    struct USBMixin< usb_parent_type, position, USBVendorBulk > : USBVendorBulk {
+
+        typedef USBMixin<usb_parent_type, position, USBVendorBulk> this_type;
+
+        // USBVendorBulk defines endpoints_used
+        static const uint8_t interfaces_used = 1;
+
+        USBVendorPipes< usb_parent_type > Vendor;
+
+        USBMixin (usb_parent_type &usb_parent,
+                   const uint8_t new_endpoint_offset,
+                   const uint8_t first_interface_number
+                   )
+        : Vendor(usb_parent, new_endpoint_offset, first_interface_number)
+        {};
+
+        const EndpointBufferSettings_t getEndpointConfigFromMixin(const uint8_t endpoint, const USBDeviceSpeed_t deviceSpeed, const bool other_speed) const {
+            return Vendor.getEndpointSettings(endpoint, deviceSpeed, other_speed);
+        };
+        void handleConnectionStateChangedInMixin(const bool connected) {
+            Vendor.handleConnectionStateChanged(connected);
+        };
+        bool handleNonstandardRequestInMixin(const Setup_t &setup) {
+            return Vendor.handleNonstandardRequest(setup);
+        };
+        bool handleTransferDoneInMixin(const uint8_t &endpointNum) {
+            return Vendor.handleTransferDone(endpointNum);
+        }
+        bool handleDataAvailableInMixin(const uint8_t &endpointNum, const size_t &length) {
+            return false;
+        }
+        uint16_t getEndpointSizeFromMixin(const uint8_t endpoint, const USBDeviceSpeed_t deviceSpeed, const bool otherSpeed) const {
+            return Vendor.getEndpointSize(endpoint, deviceSpeed, otherSpeed);
+        };
+        bool sendSpecialDescriptorOrConfig(const Setup_t &setup) const {
+            return Vendor.sendSpecialDescriptorOrConfig(setup);
+        };
+    };
+
+#pragma mark USBConfigMixin< USBVendorBulk, ?, ? >
+
+    // The vendor interface is a single interface, so it doesn't need an IAD in a composite device.
+    template <uint8_t usb_interface_positon, uint8_t interface_count>
+    struct USBConfigMixin<USBVendorBulk, usb_interface_positon, interface_count>
+    {
+        static const uint8_t interfaces = 1;
+        static const uint8_t endpoints = 2;
+
+        const USBDescriptorInterface_t Vendor_Interface;
+        const USBDescriptorEndpoint_t  Vendor_DataOutEndpoint;
+        const USBDescriptorEndpoint_t  Vendor_DataInEndpoint;
+
+        USBConfigMixin (
+                         const uint8_t _first_endpoint_number,
+                         const uint8_t _first_interface_number,
+                         const USBDeviceSpeed_t _deviceSpeed,
+                         const bool _other_speed
+                         )
+        : Vendor_Interface(
+                           /* _InterfaceNumber   = */ _first_interface_number,
+                           /* _AlternateSetting  = */ 0,
+                           /* _TotalEndpoints    = */ 2,
+
+                           /* _Class             = */ kVendorSpecificClass,
+                           /* _SubClass          = */ kNoDeviceSubclass,
+                           /* _Protocol          = */ kNoDeviceProtocol,
+
+                           /* _InterfaceStrIndex = */ 0 // none
+                           ),
+        Vendor_DataOutEndpoint(
+                               /* _deviceSpeed       = */ _deviceSpeed,
+                               /* _otherSpeed        = */ _other_speed,
+                               /* _input             = */ false,
+                               /* _EndpointAddress   = */ _first_endpoint_number,
+                               /* _Attributes        = */ (kEndpointTypeBulk | kEndpointAttrNoSync | kEndpointUsageData),
+                               /* _PollingIntervalMS = */ 0x01
+                               ),
+        Vendor_DataInEndpoint(
+                              /* _deviceSpeed       = */ _deviceSpeed,
+                              /* _otherSpeed        = */ _other_speed,
+                              /* _input             = */ true,
+                              /* _EndpointAddress   = */ _first_endpoint_number+1,
+                              /* _Attributes        = */ (kEndpointTypeBulk | kEndpointAttrNoSync | kEndpointUsageData),
+                              /* _PollingIntervalMS = */ 0x01
+                              )
+        {};
+
+        static bool isNull() { return false; };
+    };
+}
+
+#endif /* end of include guard: MOTATEUSBVENDOR_H_ONCE */